@@ -0,0 +1,196 @@
+// Allocator microbenchmark: the size-class arena (gc_alloc in runtime.c)
+// against the allocator it replaced (malloc + a 131072-entry allocation
+// table + a pointer hash), reproduced below as legacy_*.
+//
+// Each round allocates a batch of small strings, marks every other one via
+// a pointer lookup (as the mark phase does) and sweeps the rest.
+//
+// Includes runtime.c directly to reach the static allocator.
+// Build & run: make bench
+#include "../runtime/runtime.c"
+
+#define BATCH 50000 // Keeps the legacy table below its 131072-slot limit
+#define ROUNDS 40
+
+// ============================================================================
+// Legacy allocator (as it was before the arena)
+// ============================================================================
+
+#define LEGACY_MAX_ALLOCATIONS 131072
+#define LEGACY_HASH_SIZE 262144
+
+typedef struct {
+  void *ptr;
+  int type;
+  int marked;
+  int in_use;
+} LegacyAllocation;
+
+typedef struct {
+  void *ptr;
+  int slot;
+} LegacyHashEntry;
+
+static LegacyAllocation legacy_allocations[LEGACY_MAX_ALLOCATIONS];
+static LegacyHashEntry legacy_hash[LEGACY_HASH_SIZE];
+static int legacy_next_slot = 0;
+
+static unsigned int legacy_hash_ptr(void *ptr) {
+  uintptr_t x = (uintptr_t)ptr;
+  x = (x ^ (x >> 16)) * 0x45d9f3b;
+  x = (x ^ (x >> 16)) * 0x45d9f3b;
+  x = x ^ (x >> 16);
+  return (unsigned int)(x & (LEGACY_HASH_SIZE - 1));
+}
+
+static void legacy_hash_insert(void *ptr, int slot) {
+  unsigned int h = legacy_hash_ptr(ptr);
+  for (int i = 0; i < LEGACY_HASH_SIZE; i++) {
+    unsigned int idx = (h + i) & (LEGACY_HASH_SIZE - 1);
+    if (legacy_hash[idx].ptr == NULL || legacy_hash[idx].ptr == ptr) {
+      legacy_hash[idx].ptr = ptr;
+      legacy_hash[idx].slot = slot;
+      return;
+    }
+  }
+}
+
+static void legacy_hash_remove(void *ptr) {
+  unsigned int h = legacy_hash_ptr(ptr);
+  int found = -1;
+  for (int i = 0; i < LEGACY_HASH_SIZE; i++) {
+    unsigned int idx = (h + i) & (LEGACY_HASH_SIZE - 1);
+    if (legacy_hash[idx].ptr == ptr) {
+      found = idx;
+      break;
+    }
+    if (legacy_hash[idx].ptr == NULL)
+      return;
+  }
+  if (found == -1)
+    return;
+  legacy_hash[found].ptr = NULL;
+  int j = found;
+  while (1) {
+    j = (j + 1) & (LEGACY_HASH_SIZE - 1);
+    if (legacy_hash[j].ptr == NULL)
+      break;
+    void *p = legacy_hash[j].ptr;
+    int slot = legacy_hash[j].slot;
+    legacy_hash[j].ptr = NULL;
+    legacy_hash_insert(p, slot);
+  }
+}
+
+static void *legacy_alloc(size_t size, int type) {
+  void *ptr = malloc(size);
+  int i = legacy_next_slot;
+  do {
+    if (!legacy_allocations[i].in_use) {
+      legacy_allocations[i].ptr = ptr;
+      legacy_allocations[i].type = type;
+      legacy_allocations[i].marked = 0;
+      legacy_allocations[i].in_use = 1;
+      legacy_hash_insert(ptr, i);
+      legacy_next_slot = (i + 1) % LEGACY_MAX_ALLOCATIONS;
+      return ptr;
+    }
+    i = (i + 1) % LEGACY_MAX_ALLOCATIONS;
+  } while (i != legacy_next_slot);
+  return ptr;
+}
+
+static void legacy_mark_ptr(void *ptr) {
+  unsigned int h = legacy_hash_ptr(ptr);
+  for (int i = 0; i < LEGACY_HASH_SIZE; i++) {
+    unsigned int idx = (h + i) & (LEGACY_HASH_SIZE - 1);
+    if (legacy_hash[idx].ptr == ptr) {
+      legacy_allocations[legacy_hash[idx].slot].marked = 1;
+      return;
+    }
+    if (legacy_hash[idx].ptr == NULL)
+      return;
+  }
+}
+
+static void legacy_sweep(void) {
+  for (int i = 0; i < LEGACY_MAX_ALLOCATIONS; i++) {
+    if (!legacy_allocations[i].in_use)
+      continue;
+    if (legacy_allocations[i].marked) {
+      legacy_allocations[i].marked = 0;
+    } else {
+      legacy_hash_remove(legacy_allocations[i].ptr);
+      free(legacy_allocations[i].ptr);
+      legacy_allocations[i].in_use = 0;
+    }
+  }
+}
+
+// ============================================================================
+// Driver
+// ============================================================================
+
+static double bench_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+typedef struct {
+  double alloc, mark, sweep;
+} Timings;
+
+static void *ptrs[BATCH];
+
+static Timings run(void *(*alloc)(size_t, int), void (*mark)(void *),
+                   void (*sweep)(void)) {
+  Timings t = {0, 0, 0};
+  for (int r = 0; r < ROUNDS; r++) {
+    double t0 = bench_now_ms();
+    for (int i = 0; i < BATCH; i++) {
+      // Mostly short strings, like ints-to-string and single chars
+      ptrs[i] = alloc(2 + (i * 7) % 40, GC_TYPE_STRING);
+      ((char *)ptrs[i])[0] = 'x';
+    }
+    double t1 = bench_now_ms();
+    for (int i = 0; i < BATCH; i += 2)
+      mark(ptrs[i]);
+    double t2 = bench_now_ms();
+    sweep();
+    double t3 = bench_now_ms();
+    t.alloc += t1 - t0;
+    t.mark += t2 - t1;
+    t.sweep += t3 - t2;
+  }
+  return t;
+}
+
+static void *arena_alloc(size_t size, int type) {
+  return gc_alloc(size, (GcAllocType)type);
+}
+
+// Whole-heap sweep, then a new epoch so this round's marks turn white
+static void arena_sweep(void) {
+  long budget = LONG_MAX;
+  gc_sweep_heap_begin();
+  gc_sweep_heap_step(&budget);
+  gc_epoch = gc_epoch % 255 + 1;
+}
+
+static void print_row(const char *name, Timings t) {
+  double per = 1e6 / ((double)BATCH * ROUNDS); // ms total -> ns per op
+  printf("%-8s alloc %6.1f ns/op   mark %6.1f ns/op   sweep %7.2f ms/round\n",
+         name, t.alloc * per, t.mark * 2 * per, t.sweep / ROUNDS);
+}
+
+int main(void) {
+  printf("%d rounds of %d allocations, half survive each sweep\n", ROUNDS,
+         BATCH);
+  // Marked survivors are swept next round, so both start from the same state
+  Timings legacy = run(legacy_alloc, legacy_mark_ptr, legacy_sweep);
+  Timings arena = run(arena_alloc, gc_mark_ptr, arena_sweep);
+  print_row("legacy", legacy);
+  print_row("arena", arena);
+  return 0;
+}
@@ -0,0 +1,121 @@
+// JSON encode benchmark: encode a full_map_scan result (the 50x20 tile grid
+// as one-char strings, plus entity, item and player objects) with
+// ds_json_encode and with ds_json_write into a counting sink.
+//
+// Build & run: make bench
+#include "../runtime/runtime.h"
+#include <stdio.h>
+#include <time.h>
+
+#define MAP_WIDTH 50
+#define MAP_HEIGHT 20
+#define ENTITIES 12
+#define ITEMS 8
+#define RUNS 2000
+
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static Value roots[1];
+
+static Value entry(const char *k1, long v1, const char *k2, long v2,
+                   const char *k3, long v3) {
+  Value obj = ds_object_create(VAL_INT(0));
+  ds_set_prop(obj, ds_intern(str_from_c(k1)), VAL_INT(v1));
+  ds_set_prop(obj, ds_intern(str_from_c(k2)), VAL_INT(v2));
+  ds_set_prop(obj, ds_intern(str_from_c(k3)), VAL_INT(v3));
+  return obj;
+}
+
+// The same shape full_map_scan returns, over a dungeon of boxed rooms
+static Value map_scan(void) {
+  Value result = ds_object_create(VAL_INT(0));
+  GC_WB_AT(roots[0], result);
+  ds_set_prop(result, STR_LIT("width"), VAL_INT(MAP_WIDTH));
+  ds_set_prop(result, STR_LIT("height"), VAL_INT(MAP_HEIGHT));
+
+  Value tiles = ds_list_create();
+  ds_set_prop(result, STR_LIT("tiles"), tiles);
+  for (int y = 0; y < MAP_HEIGHT; y++) {
+    Value row = ds_list_create();
+    ds_list_push(tiles, row);
+    for (int x = 0; x < MAP_WIDTH; x++) {
+      int rx = x % 12, ry = y % 10;
+      char c = ' ';
+      if (rx == 0 || rx == 11)
+        c = ry == 0 || ry == 9 ? '-' : '|';
+      else if (ry == 0 || ry == 9)
+        c = rx == 6 ? '+' : '-';
+      else if (rx < 11)
+        c = '.';
+      if (ry == 5 && rx == 11)
+        c = '#';
+      ds_list_push(row, ds_char_to_string(VAL_INT(c)));
+    }
+  }
+
+  Value entities = ds_list_create();
+  ds_set_prop(result, STR_LIT("entities"), entities);
+  for (int i = 0; i < ENTITIES; i++) {
+    Value ent = entry("x", 3 + i * 4 % MAP_WIDTH, "y", 2 + i % 7, "type",
+                      'a' + i);
+    ds_set_prop(ent, STR_LIT("hp"), VAL_INT(10 + i));
+    ds_list_push(entities, ent);
+  }
+
+  Value items = ds_list_create();
+  ds_set_prop(result, STR_LIT("items"), items);
+  for (int i = 0; i < ITEMS; i++) {
+    ds_list_push(items, entry("x", i * 6, "y", 1 + i * 2 % MAP_HEIGHT, "type",
+                              i % 2 ? 5 : 6));
+  }
+
+  Value player = entry("x", 10, "y", 4, "hp", 16);
+  ds_set_prop(player, STR_LIT("max_hp"), VAL_INT(16));
+  ds_set_prop(player, STR_LIT("gold"), VAL_INT(230));
+  ds_set_prop(result, STR_LIT("player"), player);
+  return result;
+}
+
+static size_t sink_bytes = 0;
+
+static void count_sink(const char *chars, size_t length, void *ctx) {
+  (void)chars;
+  (void)ctx;
+  sink_bytes += length;
+}
+
+int main(void) {
+  gc_register_root_array(roots, 1);
+  Value scan = map_scan();
+
+  long bytes = 0;
+  double best = 1e9;
+  for (int i = 0; i < RUNS; i++) {
+    double t0 = now_ms();
+    Value json = ds_json_encode(scan);
+    double t = now_ms() - t0;
+    bytes = str_length(json);
+    if (t < best)
+      best = t;
+  }
+
+  double best_sink = 1e9;
+  for (int i = 0; i < RUNS; i++) {
+    sink_bytes = 0;
+    double t0 = now_ms();
+    ds_json_write(scan, count_sink, NULL);
+    double t = now_ms() - t0;
+    if (t < best_sink)
+      best_sink = t;
+  }
+
+  printf("full_map_scan JSON:        %ld bytes\n", bytes);
+  printf("ds_json_encode best:       %8.1f us\n", best * 1000);
+  printf("ds_json_write (sink) best: %8.1f us  (%zu bytes)\n",
+         best_sink * 1000, sink_bytes);
+  return 0;
+}
@@ -0,0 +1,94 @@
+// Object layout benchmark: startup cost and resident memory of the object
+// table. Creates a typical mix of small objects (2-6 fields) plus a few wide
+// ones and reports wall time and RSS at each stage.
+//
+// Build & run: make bench
+#include "../runtime/runtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#define SMALL_OBJECTS 20000
+#define WIDE_OBJECTS 200
+#define WIDE_FIELDS 40
+
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Current resident set in KB (VmRSS), falling back to peak RSS
+static long rss_kb(void) {
+  FILE *f = fopen("/proc/self/status", "r");
+  if (f) {
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+      if (strncmp(line, "VmRSS:", 6) == 0) {
+        fclose(f);
+        return atol(line + 6);
+      }
+    }
+    fclose(f);
+  }
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_maxrss;
+}
+
+static Value field_names[WIDE_FIELDS]; // Interned, so never collected
+
+int main(void) {
+  static Value roots[SMALL_OBJECTS + WIDE_OBJECTS];
+  gc_register_root_array(roots, SMALL_OBJECTS + WIDE_OBJECTS);
+
+  for (int i = 0; i < WIDE_FIELDS; i++) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "f%d", i);
+    field_names[i] = ds_intern(str_from_c(buf));
+  }
+
+  long rss_start = rss_kb();
+  double t0 = now_ms();
+
+  // First object: pays for any table initialisation
+  roots[0] = ds_object_create(VAL_INT(0));
+  double t_first = now_ms();
+  long rss_first = rss_kb();
+
+  for (int i = 1; i < SMALL_OBJECTS; i++) {
+    Value obj = ds_object_create(VAL_INT(0));
+    int fields = 2 + i % 5;
+    for (int f = 0; f < fields; f++) {
+      ds_set_prop(obj, field_names[f], VAL_INT(i + f));
+    }
+    roots[i] = obj;
+  }
+  for (int i = 0; i < WIDE_OBJECTS; i++) {
+    Value obj = ds_object_create(VAL_INT(0));
+    for (int f = 0; f < WIDE_FIELDS; f++) {
+      ds_set_prop(obj, field_names[f], VAL_INT(f));
+    }
+    roots[SMALL_OBJECTS + i] = obj;
+  }
+  double t_fill = now_ms();
+  long rss_fill = rss_kb();
+
+  // Read everything back so the fill can't be optimised away
+  long sum = 0;
+  for (int i = 1; i < SMALL_OBJECTS + WIDE_OBJECTS; i++) {
+    sum += AS_INT(ds_object_get(roots[i], field_names[1]));
+  }
+  double t_read = now_ms();
+
+  printf("first object (table init): %8.3f ms  rss %7ld KB\n", t_first - t0,
+         rss_first);
+  printf("create %5d objects:       %8.3f ms  rss %7ld KB\n",
+         SMALL_OBJECTS + WIDE_OBJECTS, t_fill - t_first, rss_fill);
+  printf("read back:                 %8.3f ms  (checksum %ld)\n",
+         t_read - t_fill, sum);
+  printf("rss growth from start:     %ld KB\n", rss_fill - rss_start);
+  return 0;
+}
@@ -8,6 +8,7 @@ static FILE *out;
 static int indent_level = 0;
 static int temp_counter = 0;
 static int lambda_counter = 0;
+static int prop_cache_counter = 0; // Per-site property inline caches
 static int in_main = 0; // Track if we're generating main() function
 
 // GC root tracking - collect global arrays and string variables
@@ -34,6 +35,21 @@ static void collect_gc_root_array(const char *name) {
   }
 }
 
+// Index of a root among those collected, or -1
+static int gc_root_index(const char *name, int is_array) {
+  GcRootInfo *roots = is_array ? gc_root_arrays : gc_root_values;
+  int count = is_array ? gc_root_array_count : gc_root_value_count;
+  for (int i = 0; i < count; i++) {
+    if (strcmp(roots[i].name, name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+static int is_gc_root(const char *name, int is_array) {
+  return gc_root_index(name, is_array) >= 0;
+}
+
 static void collect_gc_root_value(const char *name) {
   if (gc_root_value_count < MAX_GC_ROOT_VALUES) {
     strncpy(gc_root_values[gc_root_value_count].name, name, 63);
@@ -43,6 +59,87 @@ static void collect_gc_root_value(const char *name) {
   }
 }
 
+// Member-name atoms - every field name used in obj->field or an object literal
+// gets a `static int __atom_N`, interned once in __gc_register_roots
+#define MAX_MEMBER_ATOMS 4096
+
+static char *member_atoms[MAX_MEMBER_ATOMS];
+static int member_atom_count = 0;
+
+static int member_atom(const char *name) {
+  for (int i = 0; i < member_atom_count; i++) {
+    if (strcmp(member_atoms[i], name) == 0)
+      return i;
+  }
+  if (member_atom_count >= MAX_MEMBER_ATOMS) {
+    fprintf(stderr, "Too many distinct member names (max %d)\n",
+            MAX_MEMBER_ATOMS);
+    exit(1);
+  }
+  member_atoms[member_atom_count] = strdup(name);
+  return member_atom_count++;
+}
+
+// String literals - each distinct one becomes a `static ... __str_N` with its
+// length and hash precomputed (NH_STR_DEF), so the runtime never has to
+// measure it
+#define MAX_STRING_LITERALS 16384
+
+static char *string_literals[MAX_STRING_LITERALS];
+static int string_literal_count = 0;
+
+static int string_literal(const char *value) {
+  for (int i = 0; i < string_literal_count; i++) {
+    if (strcmp(string_literals[i], value) == 0)
+      return i;
+  }
+  if (string_literal_count >= MAX_STRING_LITERALS) {
+    fprintf(stderr, "Too many distinct string literals (max %d)\n",
+            MAX_STRING_LITERALS);
+    exit(1);
+  }
+  string_literals[string_literal_count] = strdup(value);
+  return string_literal_count++;
+}
+
+// FNV-1a cut to 31 bits, as the runtime's str_hash computes it
+static unsigned int string_hash(const char *s) {
+  unsigned int hash = 2166136261u;
+  for (; *s; s++) {
+    hash = (hash ^ (unsigned char)*s) * 16777619u;
+  }
+  hash &= 0x7fffffffu;
+  return hash ? hash : 1;
+}
+
+// Write s as a C string literal
+static void write_c_string(FILE *f, const char *s) {
+  fputc('"', f);
+  for (; *s; s++) {
+    switch (*s) {
+    case '\n':
+      fputs("\\n", f);
+      break;
+    case '\r':
+      fputs("\\r", f);
+      break;
+    case '\t':
+      fputs("\\t", f);
+      break;
+    case '\\':
+      fputs("\\\\", f);
+      break;
+    case '"':
+      fputs("\\\"", f);
+      break;
+    default:
+      fputc(*s, f);
+      break;
+    }
+  }
+  fputc('"', f);
+}
+
 // Track context for implicit _ (the piped/matched value)
 #define MAX_CONTEXT_DEPTH 32
 static const char *implicit_context[MAX_CONTEXT_DEPTH];
@@ -146,153 +243,1510 @@ static const char *binop_to_c(BinaryOp op) {
   }
 }
 
-// Forward declarations
-static void codegen_expr(ASTNode *node);
-static void codegen_stmt(ASTNode *node);
+// Forward declarations
+static void codegen_expr(ASTNode *node);
+static void codegen_stmt(ASTNode *node);
+static void codegen_int(ASTNode *node);
+static int is_raw_int(const char *name);
+
+// Identify which function arguments should be treated as floats
+static int is_float_func_arg(const char *name, int arg_idx) {
+  if (strcmp(name, "gl_clear_color") == 0)
+    return 1; // All 4 args
+  if (strcmp(name, "gl_uniform1f") == 0 && arg_idx >= 1)
+    return 1;
+  if (strcmp(name, "gl_uniform2f") == 0 && arg_idx >= 1)
+    return 1;
+  if (strcmp(name, "gl_uniform3f") == 0 && arg_idx >= 1)
+    return 1;
+  if (strcmp(name, "gl_uniform4f") == 0 && arg_idx >= 1)
+    return 1;
+  if (strcmp(name, "buf_set_float") == 0 && arg_idx == 2)
+    return 1;
+  if (strcmp(name, "ds_array_set_float") == 0 && arg_idx == 2)
+    return 1;
+  if (strcmp(name, "ds_array_fill_float") == 0 && arg_idx == 1)
+    return 1;
+  return 0;
+}
+
+// Registry of variables known to hold float values
+#define MAX_FLOAT_VARS 256
+static char *float_vars[MAX_FLOAT_VARS];
+static int float_var_count = 0;
+
+static int is_float_var(const char *name);
+
+static void register_float_var(const char *name) {
+  if (float_var_count < MAX_FLOAT_VARS && !is_float_var(name)) {
+    float_vars[float_var_count++] = strdup(name);
+  }
+}
+
+static int is_float_var(const char *name) {
+  for (int i = 0; i < float_var_count; i++) {
+    if (strcmp(float_vars[i], name) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+// Typed arrays: a name only ever given the result of one typed array creator
+// (ds_array_int32, ds_array_uint8 or ds_array_float32) is known to hold that
+// kind, and indexing it becomes a direct load or store of the element. Maps
+// (ds_map_create) are tracked the same way, and indexing one becomes a
+// ds_map_get or ds_map_set. Globals come first and are found once per
+// program; each function's locals follow them and are found again by
+// prepare_locals.
+enum { TYPED_NONE, TYPED_INT32, TYPED_UINT8, TYPED_FLOAT32, TYPED_MAP };
+
+static const char *typed_array_ctype[] = {NULL, "int32_t", "uint8_t", "float",
+                                          NULL};
+
+typedef struct {
+  const char *name;
+  int kind; // TYPED_*, or -1 for a global not yet given an array
+} TypedArrayInfo;
+
+#define MAX_TYPED_ARRAYS 2048
+static TypedArrayInfo typed_arrays[MAX_TYPED_ARRAYS];
+static int typed_array_count = 0;
+static int typed_global_count = 0;
+
+// The kind a creator call makes, TYPED_NONE for anything else
+static int typed_array_creator(ASTNode *node) {
+  if (!node || node->type != NODE_WAND_CALL)
+    return TYPED_NONE;
+  const char *name = node->data.wand_call.name;
+  if (strcmp(name, "ds_array_int32") == 0)
+    return TYPED_INT32;
+  if (strcmp(name, "ds_array_uint8") == 0)
+    return TYPED_UINT8;
+  if (strcmp(name, "ds_array_float32") == 0)
+    return TYPED_FLOAT32;
+  if (strcmp(name, "ds_map_create") == 0)
+    return TYPED_MAP;
+  return TYPED_NONE;
+}
+
+static TypedArrayInfo *find_typed_array(const char *name) {
+  for (int i = typed_array_count - 1; i >= 0; i--) {
+    if (strcmp(typed_arrays[i].name, name) == 0)
+      return &typed_arrays[i];
+  }
+  return NULL;
+}
+
+static void add_typed_array(const char *name, int kind) {
+  if (typed_array_count < MAX_TYPED_ARRAYS) {
+    typed_arrays[typed_array_count].name = name;
+    typed_arrays[typed_array_count].kind = kind;
+    typed_array_count++;
+  }
+}
+
+// The kind an expression is known to be, TYPED_NONE if any
+static int typed_kind(ASTNode *node) {
+  if (!node || node->type != NODE_IDENTIFIER)
+    return TYPED_NONE;
+  TypedArrayInfo *info = find_typed_array(node->data.identifier.name);
+  return info && info->kind > 0 ? info->kind : TYPED_NONE;
+}
+
+// The kind of typed array an expression is known to be, TYPED_NONE if any
+static int typed_array_kind(ASTNode *node) {
+  int kind = typed_kind(node);
+  return kind == TYPED_MAP ? TYPED_NONE : kind;
+}
+
+// Helper to check if an expression involves floats (recursively)
+static int is_float_expr(ASTNode *node) {
+  if (!node)
+    return 0;
+  switch (node->type) {
+  case NODE_FLOAT_LITERAL:
+    return 1;
+  case NODE_IDENTIFIER:
+    // Check if this variable was declared with a float expression
+    return is_float_var(node->data.identifier.name);
+  case NODE_BINARY_OP:
+    // If either operand involves floats, the result is float
+    return is_float_expr(node->data.binary.left) ||
+           is_float_expr(node->data.binary.right);
+  case NODE_UNARY_OP:
+    return is_float_expr(node->data.unary.operand);
+  case NODE_INDEX:
+    return typed_array_kind(node->data.index.array) == TYPED_FLOAT32;
+  case NODE_WAND_CALL:
+    return strcmp(node->data.wand_call.name, "ds_array_get_float") == 0;
+  default:
+    return 0;
+  }
+}
+
+// Constant globals: a global initialized with a constant int expression and
+// never assigned, nor shadowed by a parameter, anywhere in the program is
+// folded into every use, so `y * MAP_WIDTH + x` compiles to `y * 50 + x` and
+// MAP_WIDTH * MAP_HEIGHT to a single literal. Found once per program by
+// find_constants.
+typedef struct {
+  const char *name;
+  long value;
+  int state; // CONST_*
+} ConstantInfo;
+
+enum { CONST_RULED_OUT, CONST_CANDIDATE, CONST_FOLDED };
+
+#define MAX_CONSTANTS 2048
+static ConstantInfo constants[MAX_CONSTANTS];
+static int constant_count = 0;
+
+static ConstantInfo *find_constant(const char *name) {
+  for (int i = 0; i < constant_count; i++) {
+    if (strcmp(constants[i].name, name) == 0)
+      return &constants[i];
+  }
+  return NULL;
+}
+
+// The value of an int expression made only of literals and constant globals,
+// computed as the generated code would; 0 if it isn't one
+static int const_value(ASTNode *node, long *value) {
+  long a, b;
+  if (!node || is_float_expr(node))
+    return 0;
+  switch (node->type) {
+  case NODE_INT_LITERAL:
+    *value = (long)node->data.int_literal.value;
+    return 1;
+  case NODE_BOOL_LITERAL:
+    *value = (long)node->data.bool_literal.value;
+    return 1;
+  case NODE_IDENTIFIER: {
+    ConstantInfo *info = find_constant(node->data.identifier.name);
+    if (!info || info->state != CONST_FOLDED)
+      return 0;
+    *value = info->value;
+    return 1;
+  }
+  case NODE_UNARY_OP:
+    if (!const_value(node->data.unary.operand, &a))
+      return 0;
+    *value = node->data.unary.op == OP_NOT ? a == 0
+                                           : (long)-(unsigned long)a;
+    return 1;
+  case NODE_BINARY_OP:
+    if (!const_value(node->data.binary.left, &a) ||
+        !const_value(node->data.binary.right, &b))
+      return 0;
+    switch (node->data.binary.op) {
+    case OP_ADD:
+      *value = (long)((unsigned long)a + (unsigned long)b);
+      return 1;
+    case OP_SUB:
+      *value = (long)((unsigned long)a - (unsigned long)b);
+      return 1;
+    case OP_MUL:
+      *value = (long)((unsigned long)a * (unsigned long)b);
+      return 1;
+    case OP_DIV:
+    case OP_MOD:
+      if (b == 0 || (a == -__LONG_MAX__ - 1 && b == -1))
+        return 0; // Left for the program to fault on
+      *value = node->data.binary.op == OP_DIV ? a / b : a % b;
+      return 1;
+    case OP_EQ:
+      *value = a == b;
+      return 1;
+    case OP_NE:
+      *value = a != b;
+      return 1;
+    case OP_LT:
+      *value = a < b;
+      return 1;
+    case OP_GT:
+      *value = a > b;
+      return 1;
+    case OP_LE:
+      *value = a <= b;
+      return 1;
+    case OP_GE:
+      *value = a >= b;
+      return 1;
+    case OP_AND:
+      *value = a != 0 && b != 0;
+      return 1;
+    case OP_OR:
+      *value = a != 0 || b != 0;
+      return 1;
+    }
+    return 0;
+  case NODE_TERNARY:
+    if (!const_value(node->data.ternary.condition, &a))
+      return 0;
+    return const_value(a ? node->data.ternary.then_expr
+                         : node->data.ternary.else_expr,
+                       value);
+  default:
+    return 0;
+  }
+}
+
+// Load an element of a known typed array: raw (an int or float C value), or
+// tagged as a Value for the int kinds
+static void codegen_typed_load(ASTNode *node, int raw) {
+  int kind = typed_array_kind(node->data.index.array);
+  int tag = !raw && kind != TYPED_FLOAT32;
+  if (tag)
+    emit_raw("VAL_INT(");
+  emit_raw("ARRAY_DATA(");
+  codegen_expr(node->data.index.array);
+  emit_raw(", %s)[", typed_array_ctype[kind]);
+  codegen_int(node->data.index.index);
+  emit_raw("]");
+  if (tag)
+    emit_raw(")");
+}
+
+// Emit an expression for use in a float context
+// Non-float identifiers (function params, etc.) are integers - unwrap them
+static void codegen_float_operand(ASTNode *node) {
+  if (node && node->type == NODE_IDENTIFIER &&
+      !is_float_var(node->data.identifier.name)) {
+    // This is a non-float identifier (likely a function parameter) - unwrap it
+    codegen_int(node);
+  } else if (node && node->type == NODE_INDEX &&
+             typed_array_kind(node->data.index.array)) {
+    codegen_typed_load(node, 1);
+  } else {
+    codegen_expr(node);
+  }
+}
+
+// Structure to collect lambdas for forward declaration
+typedef struct {
+  int id;
+  ASTList *params;
+  ASTNode *body;
+} LambdaInfo;
+
+#define MAX_LAMBDAS 256
+static LambdaInfo collected_lambdas[MAX_LAMBDAS];
+static int collected_lambda_count = 0;
+
+// Collect lambda for later emission
+static int collect_lambda(ASTList *params, ASTNode *body) {
+  int id = lambda_counter++;
+  if (collected_lambda_count < MAX_LAMBDAS) {
+    collected_lambdas[collected_lambda_count].id = id;
+    collected_lambdas[collected_lambda_count].params = params;
+    collected_lambdas[collected_lambda_count].body = body;
+    collected_lambda_count++;
+  }
+  return id;
+}
+
+// obj.field = value becomes an inline-cached ds_object_set_ic. Each site gets
+// its own static cache inside a statement expression.
+static void codegen_member_store(ASTNode *target, ASTNode *value) {
+  int ic = prop_cache_counter++;
+  emit_raw("({ static PropCache __ic_%d; ds_object_set_ic(&", ic);
+  codegen_expr(target->data.member.object);
+  emit_raw(", __atom_%d, ", member_atom(target->data.member.member));
+  codegen_expr(value);
+  emit_raw(", &__ic_%d); })", ic);
+}
+
+// Stores into globals go through the collector's write barriers: GC_WB for
+// single globals, GC_WB_ROOT (which also logs the slot and raises the array's
+// high-water mark) for global arrays, each with its __root_N id
+static void codegen_assign(ASTNode *target, ASTNode *value) {
+  // Check if assigning to a member
+  if (target->type == NODE_MEMBER) {
+    codegen_member_store(target, value);
+    return;
+  }
+  int kind = target->type == NODE_INDEX
+                 ? typed_array_kind(target->data.index.array)
+                 : TYPED_NONE;
+  if (target->type == NODE_INDEX &&
+      typed_kind(target->data.index.array) == TYPED_MAP) {
+    // ds_map_set yields 0, so the value goes through a temp
+    int id = temp_counter++;
+    emit_raw("({ Value __elem_%d = ", id);
+    codegen_expr(value);
+    emit_raw("; ds_map_set(");
+    codegen_expr(target->data.index.array);
+    emit_raw(", ");
+    codegen_expr(target->data.index.index);
+    emit_raw(", __elem_%d); __elem_%d; })", id, id);
+    return;
+  }
+  if (kind) {
+    // A direct store, yielding the value stored
+    int id = temp_counter++;
+    int is_float = is_float_expr(value);
+    emit_raw("({ %s __elem_%d = ", is_float ? "double" : "Value", id);
+    codegen_expr(value);
+    emit_raw("; ARRAY_DATA(");
+    codegen_expr(target->data.index.array);
+    emit_raw(", %s)[", typed_array_ctype[kind]);
+    codegen_int(target->data.index.index);
+    emit_raw("] = %s__elem_%d%s; __elem_%d; })", is_float ? "" : "AS_INT(",
+             id, is_float ? "" : ")", id);
+    return;
+  }
+  int root = target->type == NODE_INDEX &&
+                     target->data.index.array->type == NODE_IDENTIFIER
+                 ? gc_root_index(
+                       target->data.index.array->data.identifier.name, 1)
+                 : -1;
+  if (root >= 0) {
+    emit_raw("GC_WB_ROOT(");
+    codegen_expr(target->data.index.array);
+    emit_raw(", __root_%d, ", root);
+    codegen_int(target->data.index.index);
+    emit_raw(", ");
+    codegen_expr(value);
+    emit_raw(")");
+    return;
+  }
+  if (target->type == NODE_IDENTIFIER &&
+      is_raw_int(target->data.identifier.name)) {
+    // Stays untagged; a caller wanting the value tags it (see NODE_ASSIGN)
+    emit_raw("%s = ", target->data.identifier.name);
+    codegen_int(value);
+    return;
+  }
+  int global = target->type == NODE_IDENTIFIER &&
+               is_gc_root(target->data.identifier.name, 0);
+  codegen_expr(target);
+  emit_raw(global ? " = GC_WB(" : " = ");
+  codegen_expr(value);
+  if (global)
+    emit_raw(")");
+}
+
+// Shadow-stack frames: parameters and locals that may hold heap values are GC
+// roots. Each function hoists such locals to its top and pushes a frame of
+// their addresses (GC_FRAME in runtime.h), popped again on every return.
+// Before a function is generated its locals are renamed apart (x, x__1, ...)
+// so hoisting can't change what a name refers to, then classified: a local
+// only ever given ints, floats or literals never holds a heap value and stays
+// an ordinary C local where it was declared.
+//
+// Each local is also given a static type, the one every value it's ever given
+// has (TY_UNKNOWN if they differ or can't be told). A local only ever given
+// ints is kept untagged as a raw C long, and tagged again only where its
+// value leaves for a call, a store or a return. Loop variables and inlined
+// lambda parameters are renamed apart too, so their names can be typed.
+#define MAX_FUNCTION_LOCALS 512
+#define MAX_SCOPE_DEPTH 1024
+
+enum { TY_UNKNOWN, TY_INT, TY_FLOAT, TY_STRING, TY_OBJECT, TY_LIST };
+
+typedef struct {
+  ASTNode *decl; // Its NODE_VAR_DECL, already renamed
+  int unboxed;   // A double or an array, emitted as declared
+  int heap;      // May hold a heap value: hoisted into the frame
+  int type;      // TY_*
+} LocalInfo;
+
+typedef struct {
+  const char *name; // A loop variable or inlined lambda parameter, renamed
+  int type;         // TY_*
+} BoundInfo;
+
+static LocalInfo function_locals[MAX_FUNCTION_LOCALS];
+static int function_local_count = 0;
+static BoundInfo function_bound[MAX_FUNCTION_LOCALS];
+static int function_bound_count = 0;
+static int frame_active = 0; // The function being generated pushed a frame
+
+typedef struct {
+  const char *name;  // As written
+  const char *cname; // As emitted
+} ScopeEntry;
+
+static ScopeEntry scope[MAX_SCOPE_DEPTH];
+static int scope_depth = 0;
+static ASTList *program_decls = NULL; // Top-level globals and functions
+
+static void push_scope(const char *name, const char *cname) {
+  if (scope_depth < MAX_SCOPE_DEPTH) {
+    scope[scope_depth].name = name;
+    scope[scope_depth].cname = cname;
+    scope_depth++;
+  }
+}
+
+static LocalInfo *find_local(const char *cname) {
+  for (int i = 0; i < function_local_count; i++) {
+    if (strcmp(function_locals[i].decl->data.var_decl.name, cname) == 0)
+      return &function_locals[i];
+  }
+  return NULL;
+}
+
+static BoundInfo *find_bound(const char *cname) {
+  for (int i = 0; i < function_bound_count; i++) {
+    if (strcmp(function_bound[i].name, cname) == 0)
+      return &function_bound[i];
+  }
+  return NULL;
+}
+
+// Taken by a global, a function, or anything already in scope or declared in
+// this function: a local hoisted under such a name would shadow it
+static int name_taken(const char *name) {
+  if (find_local(name) || find_bound(name))
+    return 1;
+  for (int i = 0; i < scope_depth; i++) {
+    if (strcmp(scope[i].cname, name) == 0)
+      return 1;
+  }
+  for (size_t i = 0; program_decls && i < program_decls->count; i++) {
+    ASTNode *decl = program_decls->items[i];
+    const char *taken = decl->type == NODE_VAR_DECL ? decl->data.var_decl.name
+                        : decl->type == NODE_FUNCTION
+                            ? decl->data.function.name
+                            : NULL;
+    if (taken && strcmp(taken, name) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+// name, or the first of name__1, name__2, ... that isn't taken
+static char *fresh_name(char *name) {
+  char *cname = name;
+  for (int n = 1; name_taken(cname); n++) {
+    if (cname != name)
+      free(cname);
+    size_t len = strlen(name) + 16;
+    cname = malloc(len);
+    snprintf(cname, len, "%s__%d", name, n);
+  }
+  return cname;
+}
+
+// Declare a loop variable or inlined lambda parameter, renamed apart
+static char *bind_name(char *name, int type) {
+  char *cname = fresh_name(name);
+  if (function_bound_count < MAX_FUNCTION_LOCALS) {
+    function_bound[function_bound_count].name = cname;
+    function_bound[function_bound_count].type = type;
+    function_bound_count++;
+  }
+  push_scope(name, cname);
+  return cname;
+}
+
+static void rename_stmt(ASTNode *node);
+
+static void rename_expr(ASTNode *node) {
+  if (!node)
+    return;
+  switch (node->type) {
+  case NODE_IDENTIFIER:
+    for (int i = scope_depth - 1; i >= 0; i--) {
+      if (strcmp(scope[i].name, node->data.identifier.name) == 0) {
+        node->data.identifier.name = (char *)scope[i].cname;
+        break;
+      }
+    }
+    break;
+  case NODE_BINARY_OP:
+    rename_expr(node->data.binary.left);
+    rename_expr(node->data.binary.right);
+    break;
+  case NODE_UNARY_OP:
+    rename_expr(node->data.unary.operand);
+    break;
+  case NODE_WAND_CALL:
+    for (size_t i = 0; node->data.wand_call.args &&
+                       i < node->data.wand_call.args->count;
+         i++) {
+      rename_expr(node->data.wand_call.args->items[i]);
+    }
+    break;
+  case NODE_ASSIGN:
+    rename_expr(node->data.assign.target);
+    rename_expr(node->data.assign.value);
+    break;
+  case NODE_INDEX:
+    rename_expr(node->data.index.array);
+    rename_expr(node->data.index.index);
+    break;
+  case NODE_ARRAY:
+    for (size_t i = 0; node->data.array.elements &&
+                       i < node->data.array.elements->count;
+         i++) {
+      rename_expr(node->data.array.elements->items[i]);
+    }
+    break;
+  case NODE_OBJECT:
+    for (size_t i = 0;
+         node->data.object.fields && i < node->data.object.fields->count;
+         i++) {
+      rename_expr(node->data.object.fields->items[i]->data.object_field.value);
+    }
+    break;
+  case NODE_RANGE:
+    rename_expr(node->data.range.start);
+    rename_expr(node->data.range.end);
+    break;
+  case NODE_TERNARY:
+    rename_expr(node->data.ternary.condition);
+    rename_expr(node->data.ternary.then_expr);
+    rename_expr(node->data.ternary.else_expr);
+    break;
+  case NODE_MEMBER:
+    rename_expr(node->data.member.object);
+    break;
+  case NODE_MATCH:
+    for (size_t i = 0;
+         node->data.match.arms && i < node->data.match.arms->count; i++) {
+      ASTNode *arm = node->data.match.arms->items[i];
+      rename_expr(arm->data.match_arm.pattern);
+      rename_expr(arm->data.match_arm.body);
+    }
+    break;
+  case NODE_PIPE: {
+    ASTNode *right = node->data.pipe.right;
+    rename_expr(node->data.pipe.left);
+    if (right->type == NODE_LAMBDA) {
+      // Inlined, so its parameter is declared in place (see NODE_PIPE)
+      int depth = scope_depth;
+      ASTList *params = right->data.lambda.params;
+      if (params && params->count > 0)
+        params->items[0]->data.param.name =
+            bind_name(params->items[0]->data.param.name, TY_UNKNOWN);
+      if (right->data.lambda.body->type != NODE_BLOCK)
+        rename_expr(right->data.lambda.body);
+      scope_depth = depth;
+    } else if (right->type != NODE_IDENTIFIER) {
+      rename_expr(right); // An identifier here names a function
+    }
+    break;
+  }
+  default:
+    // Literals, _, and lambda values (generated as functions of their own)
+    break;
+  }
+}
+
+static void rename_stmt(ASTNode *node) {
+  if (!node)
+    return;
+  int depth = scope_depth;
+  switch (node->type) {
+  case NODE_BLOCK:
+    for (size_t i = 0; node->data.block.statements &&
+                       i < node->data.block.statements->count;
+         i++) {
+      rename_stmt(node->data.block.statements->items[i]);
+    }
+    scope_depth = depth;
+    break;
+  case NODE_VAR_DECL: {
+    // The initializer still sees whatever the name meant before
+    rename_expr(node->data.var_decl.init);
+    const char *name = node->data.var_decl.name;
+    char *cname = fresh_name(node->data.var_decl.name);
+    node->data.var_decl.name = cname;
+    if (function_local_count < MAX_FUNCTION_LOCALS) {
+      function_locals[function_local_count].decl = node;
+      function_locals[function_local_count].unboxed = 0;
+      function_locals[function_local_count].heap = 0;
+      function_locals[function_local_count].type = TY_UNKNOWN;
+      function_local_count++;
+    }
+    push_scope(name, cname);
+    break;
+  }
+  case NODE_ASSIGN:
+    rename_expr(node);
+    break;
+  case NODE_LOOP:
+    rename_expr(node->data.loop.condition);
+    rename_stmt(node->data.loop.body);
+    break;
+  case NODE_FOR:
+    rename_expr(node->data.for_loop.iterable);
+    // Counting over a range, it's an int unless the body gives it otherwise
+    node->data.for_loop.var_name = bind_name(
+        node->data.for_loop.var_name,
+        node->data.for_loop.iterable->type == NODE_RANGE ? TY_INT
+                                                          : TY_UNKNOWN);
+    rename_stmt(node->data.for_loop.body);
+    scope_depth = depth;
+    break;
+  case NODE_RETURN:
+    rename_expr(node->data.return_stmt.value);
+    break;
+  case NODE_BREAK:
+    rename_expr(node->data.break_stmt.condition);
+    break;
+  case NODE_WHEN_STMT:
+    rename_expr(node->data.when_stmt.condition);
+    rename_stmt(node->data.when_stmt.action); // Generated inside its own if
+    scope_depth = depth;
+    break;
+  case NODE_EXPR_STMT:
+    rename_expr(node->data.expr_stmt.expr);
+    break;
+  default:
+    rename_expr(node); // when actions may be bare expressions
+    break;
+  }
+}
+
+// Runtime calls that always yield an int
+static const char *int_calls[] = {
+    "ds_strlen",          "ds_streq",           "ds_list_len",
+    "ds_array_len",       "ds_array_get",       "ds_array_min_index",
+    "ds_map_size",        "ds_map_has",         "ds_map_next",
+    "ds_is_list",         "ds_is_object",       "ds_is_map",
+    "ds_is_array",        "ds_is_string",       "ds_div",
+    "ds_mod",             "ds_string_at",       "rng_int",
+    "input_key_pressed",  "input_key_just_pressed",
+    "input_mouse_x",      "input_mouse_y",      "input_mouse_down",
+    "input_mouse_just_pressed",                 NULL};
+
+static int call_type(const char *name) {
+  for (int i = 0; int_calls[i] != NULL; i++) {
+    if (strcmp(name, int_calls[i]) == 0)
+      return TY_INT;
+  }
+  if (strcmp(name, "ds_object_create") == 0 ||
+      strcmp(name, "ds_map_create") == 0)
+    return TY_OBJECT;
+  if (strcmp(name, "ds_list_create") == 0)
+    return TY_LIST;
+  return TY_UNKNOWN;
+}
+
+// The static type of an expression, from the types its locals have so far
+static int expr_type(ASTNode *node) {
+  if (!node)
+    return TY_UNKNOWN;
+  if (is_float_expr(node))
+    return TY_FLOAT;
+  switch (node->type) {
+  case NODE_INT_LITERAL:
+  case NODE_BOOL_LITERAL:
+  case NODE_BINARY_OP: // Int arithmetic, comparisons and logic
+  case NODE_UNARY_OP:
+    return TY_INT;
+  case NODE_STRING_LITERAL:
+    return TY_STRING;
+  case NODE_OBJECT:
+    return TY_OBJECT;
+  case NODE_IDENTIFIER: {
+    LocalInfo *local = find_local(node->data.identifier.name);
+    if (local)
+      return local->type;
+    BoundInfo *bound = find_bound(node->data.identifier.name);
+    if (bound)
+      return bound->type;
+    long value;
+    return const_value(node, &value) ? TY_INT : TY_UNKNOWN;
+  }
+  case NODE_INDEX: // An int32 or uint8 element (float32 ones are floats)
+    return typed_array_kind(node->data.index.array) ? TY_INT : TY_UNKNOWN;
+  case NODE_TERNARY: {
+    int type = expr_type(node->data.ternary.then_expr);
+    return type == expr_type(node->data.ternary.else_expr) ? type
+                                                            : TY_UNKNOWN;
+  }
+  case NODE_WAND_CALL:
+    return call_type(node->data.wand_call.name);
+  default:
+    return TY_UNKNOWN;
+  }
+}
+
+// Narrow a local or bound name's type by one more value it's given; 1 if it
+// changed
+static int join_type(int *type, ASTNode *value) {
+  if (*type == TY_UNKNOWN || expr_type(value) == *type)
+    return 0;
+  *type = TY_UNKNOWN;
+  return 1;
+}
+
+// An untagged C long: a local only ever given ints
+static int is_raw_int(const char *name) {
+  LocalInfo *local = find_local(name);
+  return local && local->type == TY_INT && !local->heap && !local->unboxed &&
+         !is_float_var(name);
+}
+
+static int may_hold_heap(ASTNode *node) {
+  if (!node)
+    return 0;
+  if (expr_type(node) == TY_INT)
+    return 0;
+  switch (node->type) {
+  case NODE_INT_LITERAL:
+  case NODE_FLOAT_LITERAL:
+  case NODE_BOOL_LITERAL:
+  case NODE_STRING_LITERAL: // Static; only a later store could make it heap
+  case NODE_BINARY_OP:      // Arithmetic and comparisons all yield numbers
+  case NODE_UNARY_OP:
+    return 0;
+  case NODE_IDENTIFIER: {
+    LocalInfo *local = find_local(node->data.identifier.name);
+    if (local)
+      return local->heap;
+    return !is_float_var(node->data.identifier.name);
+  }
+  case NODE_TERNARY:
+    return may_hold_heap(node->data.ternary.then_expr) ||
+           may_hold_heap(node->data.ternary.else_expr);
+  case NODE_ASSIGN:
+    return may_hold_heap(node->data.assign.value);
+  case NODE_INDEX: // An element of a typed array is a number
+    return !typed_array_kind(node->data.index.array);
+  default:
+    return 1;
+  }
+}
+
+// Mark the locals given something that may be a heap value, and narrow the
+// types of those given something else, by an assignment anywhere under node;
+// 1 if any changed
+static int classify_assignments(ASTNode *node) {
+  if (!node)
+    return 0;
+  int changed = 0;
+  switch (node->type) {
+  case NODE_BLOCK:
+    for (size_t i = 0; node->data.block.statements &&
+                       i < node->data.block.statements->count;
+         i++) {
+      changed |= classify_assignments(node->data.block.statements->items[i]);
+    }
+    break;
+  case NODE_VAR_DECL:
+    changed = classify_assignments(node->data.var_decl.init);
+    break;
+  case NODE_ASSIGN: {
+    ASTNode *target = node->data.assign.target;
+    LocalInfo *local = target->type == NODE_IDENTIFIER
+                           ? find_local(target->data.identifier.name)
+                           : NULL;
+    if (local && !local->heap && !local->unboxed &&
+        may_hold_heap(node->data.assign.value)) {
+      local->heap = 1;
+      changed = 1;
+    }
+    BoundInfo *bound = target->type == NODE_IDENTIFIER
+                           ? find_bound(target->data.identifier.name)
+                           : NULL;
+    if (local)
+      changed |= join_type(&local->type, node->data.assign.value);
+    else if (bound)
+      changed |= join_type(&bound->type, node->data.assign.value);
+    changed |= classify_assignments(target) |
+               classify_assignments(node->data.assign.value);
+    break;
+  }
+  case NODE_LOOP:
+    changed = classify_assignments(node->data.loop.condition) |
+              classify_assignments(node->data.loop.body);
+    break;
+  case NODE_FOR:
+    changed = classify_assignments(node->data.for_loop.iterable) |
+              classify_assignments(node->data.for_loop.body);
+    break;
+  case NODE_RETURN:
+    changed = classify_assignments(node->data.return_stmt.value);
+    break;
+  case NODE_BREAK:
+    changed = classify_assignments(node->data.break_stmt.condition);
+    break;
+  case NODE_WHEN_STMT:
+    changed = classify_assignments(node->data.when_stmt.condition) |
+              classify_assignments(node->data.when_stmt.action);
+    break;
+  case NODE_EXPR_STMT:
+    changed = classify_assignments(node->data.expr_stmt.expr);
+    break;
+  case NODE_BINARY_OP:
+    changed = classify_assignments(node->data.binary.left) |
+              classify_assignments(node->data.binary.right);
+    break;
+  case NODE_UNARY_OP:
+    changed = classify_assignments(node->data.unary.operand);
+    break;
+  case NODE_WAND_CALL:
+    for (size_t i = 0; node->data.wand_call.args &&
+                       i < node->data.wand_call.args->count;
+         i++) {
+      changed |= classify_assignments(node->data.wand_call.args->items[i]);
+    }
+    break;
+  case NODE_INDEX:
+    changed = classify_assignments(node->data.index.array) |
+              classify_assignments(node->data.index.index);
+    break;
+  case NODE_ARRAY:
+    for (size_t i = 0; node->data.array.elements &&
+                       i < node->data.array.elements->count;
+         i++) {
+      changed |= classify_assignments(node->data.array.elements->items[i]);
+    }
+    break;
+  case NODE_OBJECT:
+    for (size_t i = 0;
+         node->data.object.fields && i < node->data.object.fields->count;
+         i++) {
+      changed |= classify_assignments(
+          node->data.object.fields->items[i]->data.object_field.value);
+    }
+    break;
+  case NODE_RANGE:
+    changed = classify_assignments(node->data.range.start) |
+              classify_assignments(node->data.range.end);
+    break;
+  case NODE_TERNARY:
+    changed = classify_assignments(node->data.ternary.condition) |
+              classify_assignments(node->data.ternary.then_expr) |
+              classify_assignments(node->data.ternary.else_expr);
+    break;
+  case NODE_MEMBER:
+    changed = classify_assignments(node->data.member.object);
+    break;
+  case NODE_MATCH:
+    for (size_t i = 0;
+         node->data.match.arms && i < node->data.match.arms->count; i++) {
+      ASTNode *arm = node->data.match.arms->items[i];
+      changed |= classify_assignments(arm->data.match_arm.pattern) |
+                 classify_assignments(arm->data.match_arm.body);
+    }
+    break;
+  case NODE_PIPE: {
+    ASTNode *right = node->data.pipe.right;
+    changed = classify_assignments(node->data.pipe.left);
+    if (right->type == NODE_LAMBDA) {
+      if (right->data.lambda.body->type != NODE_BLOCK)
+        changed |= classify_assignments(right->data.lambda.body);
+    } else {
+      changed |= classify_assignments(right);
+    }
+    break;
+  }
+  default:
+    break;
+  }
+  return changed;
+}
+
+// A binding or store of value to a typed array candidate keeps it only if
+// value is a creator of the same kind; a global's first store picks the kind
+static void typed_array_store(const char *name, ASTNode *value) {
+  TypedArrayInfo *info = find_typed_array(name);
+  if (!info || info->kind == TYPED_NONE)
+    return;
+  int kind = typed_array_creator(value);
+  if (info->kind < 0 && kind != TYPED_NONE)
+    info->kind = kind;
+  else if (info->kind != kind)
+    info->kind = TYPED_NONE;
+}
+
+// Called with each name bound or assigned, and the value it's given (NULL for
+// parameters and loop variables)
+typedef void (*BindFn)(const char *name, ASTNode *value);
+
+static void scan_params(ASTList *params, BindFn bind) {
+  for (size_t i = 0; params && i < params->count; i++) {
+    bind(params->items[i]->data.param.name, NULL);
+  }
+}
+
+// Report every binding and assignment of a name under node
+static void scan_bindings(ASTNode *node, BindFn bind) {
+  if (!node)
+    return;
+  switch (node->type) {
+  case NODE_BLOCK:
+    for (size_t i = 0; node->data.block.statements &&
+                       i < node->data.block.statements->count;
+         i++) {
+      scan_bindings(node->data.block.statements->items[i], bind);
+    }
+    break;
+  case NODE_VAR_DECL:
+    bind(node->data.var_decl.name, node->data.var_decl.init);
+    scan_bindings(node->data.var_decl.init, bind);
+    break;
+  case NODE_ASSIGN:
+    if (node->data.assign.target->type == NODE_IDENTIFIER)
+      bind(node->data.assign.target->data.identifier.name,
+                        node->data.assign.value);
+    scan_bindings(node->data.assign.target, bind);
+    scan_bindings(node->data.assign.value, bind);
+    break;
+  case NODE_LOOP:
+    scan_bindings(node->data.loop.condition, bind);
+    scan_bindings(node->data.loop.body, bind);
+    break;
+  case NODE_FOR:
+    bind(node->data.for_loop.var_name, NULL);
+    scan_bindings(node->data.for_loop.iterable, bind);
+    scan_bindings(node->data.for_loop.body, bind);
+    break;
+  case NODE_RETURN:
+    scan_bindings(node->data.return_stmt.value, bind);
+    break;
+  case NODE_BREAK:
+    scan_bindings(node->data.break_stmt.condition, bind);
+    break;
+  case NODE_WHEN_STMT:
+    scan_bindings(node->data.when_stmt.condition, bind);
+    scan_bindings(node->data.when_stmt.action, bind);
+    break;
+  case NODE_EXPR_STMT:
+    scan_bindings(node->data.expr_stmt.expr, bind);
+    break;
+  case NODE_BINARY_OP:
+    scan_bindings(node->data.binary.left, bind);
+    scan_bindings(node->data.binary.right, bind);
+    break;
+  case NODE_UNARY_OP:
+    scan_bindings(node->data.unary.operand, bind);
+    break;
+  case NODE_WAND_CALL:
+    for (size_t i = 0; node->data.wand_call.args &&
+                       i < node->data.wand_call.args->count;
+         i++) {
+      scan_bindings(node->data.wand_call.args->items[i], bind);
+    }
+    break;
+  case NODE_INDEX:
+    scan_bindings(node->data.index.array, bind);
+    scan_bindings(node->data.index.index, bind);
+    break;
+  case NODE_ARRAY:
+    for (size_t i = 0; node->data.array.elements &&
+                       i < node->data.array.elements->count;
+         i++) {
+      scan_bindings(node->data.array.elements->items[i], bind);
+    }
+    break;
+  case NODE_OBJECT:
+    for (size_t i = 0;
+         node->data.object.fields && i < node->data.object.fields->count;
+         i++) {
+      scan_bindings(
+          node->data.object.fields->items[i]->data.object_field.value, bind);
+    }
+    break;
+  case NODE_RANGE:
+    scan_bindings(node->data.range.start, bind);
+    scan_bindings(node->data.range.end, bind);
+    break;
+  case NODE_TERNARY:
+    scan_bindings(node->data.ternary.condition, bind);
+    scan_bindings(node->data.ternary.then_expr, bind);
+    scan_bindings(node->data.ternary.else_expr, bind);
+    break;
+  case NODE_MEMBER:
+    scan_bindings(node->data.member.object, bind);
+    break;
+  case NODE_MATCH:
+    for (size_t i = 0;
+         node->data.match.arms && i < node->data.match.arms->count; i++) {
+      ASTNode *arm = node->data.match.arms->items[i];
+      scan_bindings(arm->data.match_arm.pattern, bind);
+      scan_bindings(arm->data.match_arm.body, bind);
+    }
+    break;
+  case NODE_PIPE:
+    scan_bindings(node->data.pipe.left, bind);
+    scan_bindings(node->data.pipe.right, bind);
+    break;
+  case NODE_LAMBDA:
+    scan_params(node->data.lambda.params, bind);
+    scan_bindings(node->data.lambda.body, bind);
+    break;
+  default:
+    break;
+  }
+}
+
+// A global bound or assigned anywhere but its declaration isn't a constant
+static void constant_store(const char *name, ASTNode *value) {
+  (void)value;
+  ConstantInfo *info = find_constant(name);
+  if (info)
+    info->state = CONST_RULED_OUT;
+}
+
+// Find the constant globals: every global with an int initializer is a
+// candidate until bound or assigned elsewhere, then folded once everything its
+// initializer uses has been
+static void find_constants(ASTList *decls) {
+  constant_count = 0;
+  for (size_t i = 0; i < decls->count; i++) {
+    ASTNode *decl = decls->items[i];
+    if (decl->type != NODE_VAR_DECL)
+      continue;
+    ConstantInfo *info = find_constant(decl->data.var_decl.name);
+    if (info) {
+      info->state = CONST_RULED_OUT; // Declared twice
+    } else if (constant_count < MAX_CONSTANTS) {
+      constants[constant_count].name = decl->data.var_decl.name;
+      constants[constant_count].value = 0;
+      constants[constant_count].state = CONST_CANDIDATE;
+      constant_count++;
+    }
+  }
+  for (size_t i = 0; i < decls->count; i++) {
+    ASTNode *decl = decls->items[i];
+    if (decl->type == NODE_FUNCTION) {
+      scan_params(decl->data.function.params, constant_store);
+      scan_bindings(decl->data.function.body, constant_store);
+    }
+  }
+  // In rounds, as an initializer may use a constant declared after it
+  int changed;
+  do {
+    changed = 0;
+    for (size_t i = 0; i < decls->count; i++) {
+      ASTNode *decl = decls->items[i];
+      if (decl->type != NODE_VAR_DECL)
+        continue;
+      ConstantInfo *info = find_constant(decl->data.var_decl.name);
+      if (info->state == CONST_CANDIDATE &&
+          const_value(decl->data.var_decl.init, &info->value)) {
+        info->state = CONST_FOLDED;
+        changed = 1;
+      }
+    }
+  } while (changed);
+}
+
+// Find the globals that only ever hold one kind of typed array: declared as
+// plain ints and given nothing but that kind's creator in any function. A
+// local, parameter or loop variable of the same name rules one out too.
+static void find_typed_globals(ASTList *decls) {
+  typed_array_count = 0;
+  for (size_t i = 0; i < decls->count; i++) {
+    ASTNode *decl = decls->items[i];
+    if (decl->type == NODE_VAR_DECL && decl->data.var_decl.init &&
+        decl->data.var_decl.init->type == NODE_INT_LITERAL)
+      add_typed_array(decl->data.var_decl.name, -1);
+  }
+  for (size_t i = 0; i < decls->count; i++) {
+    ASTNode *decl = decls->items[i];
+    if (decl->type == NODE_FUNCTION) {
+      scan_params(decl->data.function.params, typed_array_store);
+      scan_bindings(decl->data.function.body, typed_array_store);
+    }
+  }
+  for (int i = 0; i < typed_array_count; i++) {
+    if (typed_arrays[i].kind < 0)
+      typed_arrays[i].kind = TYPED_NONE;
+  }
+  typed_global_count = typed_array_count;
+}
 
-// Identify which function arguments should be treated as floats
-static int is_float_func_arg(const char *name, int arg_idx) {
-  if (strcmp(name, "gl_clear_color") == 0)
-    return 1; // All 4 args
-  if (strcmp(name, "gl_uniform1f") == 0 && arg_idx >= 1)
-    return 1;
-  if (strcmp(name, "gl_uniform2f") == 0 && arg_idx >= 1)
-    return 1;
-  if (strcmp(name, "gl_uniform3f") == 0 && arg_idx >= 1)
-    return 1;
-  if (strcmp(name, "gl_uniform4f") == 0 && arg_idx >= 1)
-    return 1;
-  if (strcmp(name, "buf_set_float") == 0 && arg_idx == 2)
-    return 1;
-  return 0;
+// Rename and classify the locals of a function body about to be generated
+static void prepare_locals(ASTList *params, ASTNode *body) {
+  function_local_count = 0;
+  function_bound_count = 0;
+  scope_depth = 0;
+  for (size_t i = 0; params && i < params->count; i++) {
+    push_scope(params->items[i]->data.param.name,
+               params->items[i]->data.param.name);
+  }
+  rename_stmt(body);
+  scope_depth = 0;
+
+  // Renamed apart, a local is a typed array if created as one and never
+  // given anything else
+  typed_array_count = typed_global_count;
+  for (int i = 0; i < function_local_count; i++) {
+    ASTNode *decl = function_locals[i].decl;
+    int kind = typed_array_creator(decl->data.var_decl.init);
+    if (kind)
+      add_typed_array(decl->data.var_decl.name, kind);
+  }
+  scan_bindings(body, typed_array_store);
+
+  // In order, as a float initializer may use an earlier float local
+  for (int i = 0; i < function_local_count; i++) {
+    ASTNode *init = function_locals[i].decl->data.var_decl.init;
+    if (init && init->type == NODE_ARRAY) {
+      function_locals[i].unboxed = 1;
+    } else if (init && is_float_expr(init)) {
+      register_float_var(function_locals[i].decl->data.var_decl.name);
+      function_locals[i].unboxed = 1;
+    }
+    function_locals[i].type =
+        expr_type(function_locals[i].decl->data.var_decl.init);
+  }
+  // Heap only grows and types only widen to TY_UNKNOWN, so this settles
+  int changed;
+  do {
+    changed = classify_assignments(body);
+    for (int i = 0; i < function_local_count; i++) {
+      ASTNode *init = function_locals[i].decl->data.var_decl.init;
+      changed |= join_type(&function_locals[i].type, init);
+      if (function_locals[i].heap || function_locals[i].unboxed)
+        continue;
+      if (may_hold_heap(init)) {
+        function_locals[i].heap = 1;
+        changed = 1;
+      }
+    }
+  } while (changed);
 }
 
-// Registry of variables known to hold float values
-#define MAX_FLOAT_VARS 256
-static char *float_vars[MAX_FLOAT_VARS];
-static int float_var_count = 0;
+// Hoist the heap locals and push the frame (implicit_param: the `_` a lambda
+// without parameters takes)
+static void emit_frame_enter(ASTList *params, const char *implicit_param) {
+  int slots = implicit_param ? 1 : 0;
+  slots += params ? (int)params->count : 0;
+  for (int i = 0; i < function_local_count; i++) {
+    if (function_locals[i].heap) {
+      emit("long %s = 0;\n", function_locals[i].decl->data.var_decl.name);
+      slots++;
+    }
+  }
+  frame_active = slots > 0;
+  if (!frame_active)
+    return;
+  emit("GC_FRAME(");
+  const char *sep = "";
+  if (implicit_param) {
+    emit_raw("&%s", implicit_param);
+    sep = ", ";
+  }
+  for (size_t i = 0; params && i < params->count; i++) {
+    emit_raw("%s&%s", sep, params->items[i]->data.param.name);
+    sep = ", ";
+  }
+  for (int i = 0; i < function_local_count; i++) {
+    if (function_locals[i].heap) {
+      emit_raw("%s&%s", sep, function_locals[i].decl->data.var_decl.name);
+      sep = ", ";
+    }
+  }
+  emit_raw(");\n");
+}
 
-static void register_float_var(const char *name) {
-  if (float_var_count < MAX_FLOAT_VARS) {
-    float_vars[float_var_count++] = strdup(name);
+// The end of the body, for functions that fall off it
+static void emit_frame_exit(void) {
+  if (frame_active)
+    emit("GC_FRAME_POP();\n");
+}
+
+static int ends_in_return(ASTNode *body) {
+  if (body->type == NODE_BLOCK) {
+    ASTList *stmts = body->data.block.statements;
+    return stmts && stmts->count > 0 &&
+           stmts->items[stmts->count - 1]->type == NODE_RETURN;
   }
+  return body->type == NODE_RETURN;
 }
 
-static int is_float_var(const char *name) {
-  for (int i = 0; i < float_var_count; i++) {
-    if (strcmp(float_vars[i], name) == 0)
-      return 1;
+// Return (untag: from main, as a raw exit code), popping the frame once the
+// value - which may still need the frame's roots - has been computed
+static void codegen_return(ASTNode *value, int untag) {
+  if (!value) {
+    const char *ret = untag ? "return 0;" : "return;";
+    if (frame_active)
+      emit("{ GC_FRAME_POP(); %s }\n", ret);
+    else
+      emit("%s\n", ret);
+    return;
   }
-  return 0;
+  emit("return ");
+  if (untag)
+    emit_raw("AS_INT(");
+  if (frame_active)
+    emit_raw("GC_RETURN(");
+  codegen_expr(value);
+  if (frame_active)
+    emit_raw(")");
+  if (untag)
+    emit_raw(")");
+  emit_raw(";\n");
 }
 
-// Helper to check if an expression involves floats (recursively)
-static int is_float_expr(ASTNode *node) {
-  if (!node)
+// An operator computed on untagged ints (see codegen_int): any but float
+// arithmetic and float equality, which keep their own paths
+static int is_int_op(ASTNode *node) {
+  if (node->type == NODE_UNARY_OP)
+    return node->data.unary.op == OP_NOT ||
+           !is_float_expr(node->data.unary.operand);
+  if (node->type != NODE_BINARY_OP)
     return 0;
+  BinaryOp op = node->data.binary.op;
+  if (op >= OP_LT && op <= OP_OR)
+    return 1; // Relational ops assume integers
+  return !is_float_expr(node->data.binary.left) &&
+         !is_float_expr(node->data.binary.right);
+}
+
+static void codegen_cond(ASTNode *node);
+
+// == and != as a C truth value. Ints and handles are equal only if identical,
+// as val_eq would find, so if either side is one the tagged words are compared
+// directly; only values that may both be strings go through val_eq.
+static void codegen_equality(ASTNode *node) {
+  ASTNode *left = node->data.binary.left;
+  ASTNode *right = node->data.binary.right;
+  const char *op = binop_to_c(node->data.binary.op);
+  int left_type = expr_type(left), right_type = expr_type(right);
+  if (left_type == TY_INT && right_type == TY_INT) {
+    emit_raw("(");
+    codegen_int(left);
+    emit_raw(" %s ", op);
+    codegen_int(right);
+    emit_raw(")");
+  } else if (left_type == TY_INT || left_type == TY_OBJECT ||
+             left_type == TY_LIST || right_type == TY_INT ||
+             right_type == TY_OBJECT || right_type == TY_LIST) {
+    emit_raw("((");
+    codegen_expr(left);
+    emit_raw(") %s (", op);
+    codegen_expr(right);
+    emit_raw("))");
+  } else {
+    emit_raw("(val_eq((");
+    codegen_expr(left);
+    emit_raw("), (");
+    codegen_expr(right);
+    emit_raw(")) %s VAL_INT(0))", node->data.binary.op == OP_EQ ? "!=" : "==");
+  }
+}
+
+// An int operator as an untagged C long; comparisons and logic give 0 or 1
+static void codegen_int_op(ASTNode *node) {
+  if (node->type == NODE_UNARY_OP) {
+    emit_raw(node->data.unary.op == OP_NOT ? "(!" : "(-");
+    if (node->data.unary.op == OP_NOT)
+      codegen_cond(node->data.unary.operand);
+    else
+      codegen_int(node->data.unary.operand);
+    emit_raw(")");
+    return;
+  }
+  BinaryOp op = node->data.binary.op;
+  if (op == OP_EQ || op == OP_NE) {
+    codegen_equality(node);
+  } else if (op == OP_AND || op == OP_OR) {
+    emit_raw("(");
+    codegen_cond(node->data.binary.left);
+    emit_raw(" %s ", binop_to_c(op));
+    codegen_cond(node->data.binary.right);
+    emit_raw(")");
+  } else {
+    emit_raw("(");
+    codegen_int(node->data.binary.left);
+    emit_raw(" %s ", binop_to_c(op));
+    codegen_int(node->data.binary.right);
+    emit_raw(")");
+  }
+}
+
+// An expression as an untagged C long. Int locals, literals, operators and
+// typed array elements are that already; anything else is untagged.
+static void codegen_int(ASTNode *node) {
+  long value;
+  if (const_value(node, &value)) {
+    emit_raw(value < 0 ? "(%ld)" : "%ld", value);
+    return;
+  }
   switch (node->type) {
-  case NODE_FLOAT_LITERAL:
-    return 1;
   case NODE_IDENTIFIER:
-    // Check if this variable was declared with a float expression
-    return is_float_var(node->data.identifier.name);
+    if (is_raw_int(node->data.identifier.name)) {
+      emit_raw("%s", node->data.identifier.name);
+      return;
+    }
+    break;
   case NODE_BINARY_OP:
-    // If either operand involves floats, the result is float
-    return is_float_expr(node->data.binary.left) ||
-           is_float_expr(node->data.binary.right);
   case NODE_UNARY_OP:
-    return is_float_expr(node->data.unary.operand);
+    if (is_int_op(node)) {
+      codegen_int_op(node);
+      return;
+    }
+    break;
+  case NODE_INDEX:
+    if (expr_type(node) == TY_INT) {
+      codegen_typed_load(node, 1);
+      return;
+    }
+    break;
+  case NODE_TERNARY:
+    if (expr_type(node) == TY_INT) {
+      emit_raw("(");
+      codegen_cond(node->data.ternary.condition);
+      emit_raw(" ? ");
+      codegen_int(node->data.ternary.then_expr);
+      emit_raw(" : ");
+      codegen_int(node->data.ternary.else_expr);
+      emit_raw(")");
+      return;
+    }
+    break;
+  case NODE_ASSIGN:
+    if (node->data.assign.target->type == NODE_IDENTIFIER &&
+        is_raw_int(node->data.assign.target->data.identifier.name)) {
+      emit_raw("(");
+      codegen_assign(node->data.assign.target, node->data.assign.value);
+      emit_raw(")");
+      return;
+    }
+    break;
   default:
-    return 0;
+    break;
   }
+  emit_raw("AS_INT(");
+  codegen_expr(node);
+  emit_raw(")");
 }
 
-// Emit an expression for use in a float context
-// Non-float identifiers (function params, etc.) are tagged integers - unwrap
-// them
-static void codegen_float_operand(ASTNode *node) {
-  if (node && node->type == NODE_IDENTIFIER &&
-      !is_float_var(node->data.identifier.name)) {
-    // This is a non-float identifier (likely a function parameter) - unwrap it
-    emit_raw("AS_INT(%s)", node->data.identifier.name);
+// A condition as a C truth value, so comparisons and int locals are tested
+// without being tagged first
+static void codegen_cond(ASTNode *node) {
+  long value;
+  if (const_value(node, &value)) {
+    emit_raw("%d", value != 0);
+  } else if ((node->type == NODE_BINARY_OP && node->data.binary.op >= OP_EQ &&
+       is_int_op(node)) ||
+      (node->type == NODE_UNARY_OP && node->data.unary.op == OP_NOT)) {
+    codegen_int_op(node);
+  } else if (expr_type(node) == TY_INT) {
+    emit_raw("(");
+    codegen_int(node);
+    emit_raw(" != 0)");
   } else {
+    emit_raw("((");
     codegen_expr(node);
+    emit_raw(") != VAL_INT(0))");
   }
 }
 
-// Structure to collect lambdas for forward declaration
-typedef struct {
-  int id;
-  ASTList *params;
-  ASTNode *body;
-} LambdaInfo;
+// The int a match arm's pattern is a case for: an int literal or folded
+// constant, small enough to be an int on any target
+static int case_value(ASTNode *pattern, long *value) {
+  return const_value(pattern, value) && *value >= -(1L << 30) &&
+         *value < (1L << 30);
+}
 
-#define MAX_LAMBDAS 256
-static LambdaInfo collected_lambdas[MAX_LAMBDAS];
-static int collected_lambda_count = 0;
+// A match becomes a switch if it has int cases and every other arm before any
+// wildcard is a string literal, which no int equals, so it can be tried after
+// them
+static int match_is_switch(ASTList *arms) {
+  int cases = 0;
+  for (size_t i = 0; arms && i < arms->count; i++) {
+    ASTNode *pattern = arms->items[i]->data.match_arm.pattern;
+    long value;
+    if (pattern->type == NODE_IMPLICIT)
+      break;
+    if (case_value(pattern, &value))
+      cases++;
+    else if (pattern->type != NODE_STRING_LITERAL)
+      return 0;
+  }
+  return cases > 0;
+}
 
-// Collect lambda for later emission
-static int collect_lambda(ASTList *params, ASTNode *body) {
-  int id = lambda_counter++;
-  if (collected_lambda_count < MAX_LAMBDAS) {
-    collected_lambdas[collected_lambda_count].id = id;
-    collected_lambdas[collected_lambda_count].params = params;
-    collected_lambdas[collected_lambda_count].body = body;
-    collected_lambda_count++;
+// The switch cases of a match, the first arm winning where two have the same
+static void codegen_match_cases(ASTList *arms, int match_id) {
+  long *seen = malloc(arms->count * sizeof(long));
+  size_t seen_count = 0;
+  for (size_t i = 0; i < arms->count; i++) {
+    ASTNode *pattern = arms->items[i]->data.match_arm.pattern;
+    long value;
+    if (pattern->type == NODE_IMPLICIT)
+      break;
+    if (!case_value(pattern, &value))
+      continue;
+    size_t j = 0;
+    while (j < seen_count && seen[j] != value)
+      j++;
+    if (j < seen_count)
+      continue;
+    seen[seen_count++] = value;
+    emit_raw(" case %ld: __result_%d = ", value, match_id);
+    codegen_expr(arms->items[i]->data.match_arm.body);
+    emit_raw("; break;");
   }
-  return id;
+  free(seen);
+}
+
+// A match's arms as an if-else chain comparing each pattern to the value in
+// turn (in_switch: as the default of a switch, leaving out its cases)
+static void codegen_match_chain(ASTList *arms, int match_id, int in_switch) {
+  int first = 1;
+  for (size_t i = 0; arms && i < arms->count; i++) {
+    ASTNode *pattern = arms->items[i]->data.match_arm.pattern;
+    ASTNode *body = arms->items[i]->data.match_arm.body;
+    long value;
+    if (in_switch && pattern->type != NODE_IMPLICIT &&
+        case_value(pattern, &value))
+      continue;
+
+    if (!first)
+      emit_raw(" else ");
+    else if (in_switch)
+      emit_raw(" default: ");
+    first = 0;
+
+    // Check if pattern is wildcard (_)
+    if (pattern->type == NODE_IMPLICIT) {
+      // Default case - just execute
+      emit_raw("{ __result_%d = ", match_id);
+      codegen_expr(body);
+      emit_raw("; }");
+      break;
+    }
+    // Compare pattern to match value
+    emit_raw("if (__match_%d == ", match_id);
+    codegen_expr(pattern);
+    emit_raw(") { __result_%d = ", match_id);
+    codegen_expr(body);
+    emit_raw("; }");
+  }
+  if (in_switch && !first)
+    emit_raw(" break;");
 }
 
 static void codegen_expr(ASTNode *node) {
   if (!node)
     return;
 
+  long value;
+  if (const_value(node, &value)) {
+    // Literals, and whatever folds from them and constant globals
+    emit_raw("VAL_INT(%ld)", value);
+    return;
+  }
+
   switch (node->type) {
-  case NODE_INT_LITERAL:
-    emit_raw("VAL_INT(%ld)", (long)node->data.int_literal.value);
-    break;
 
   case NODE_FLOAT_LITERAL:
     emit_raw("%f", node->data.float_literal.value);
     break;
 
-  case NODE_STRING_LITERAL: {
-    // Escape special characters for C string literal
-    // Cast to Value (OBJ) so it can be passed to runtime functions
-    const char *s = node->data.string_literal.value;
-    emit_raw("VAL_OBJ(\"");
-    for (; *s; s++) {
-      switch (*s) {
-      case '\n':
-        emit_raw("\\n");
-        break;
-      case '\r':
-        emit_raw("\\r");
-        break;
-      case '\t':
-        emit_raw("\\t");
-        break;
-      case '\\':
-        emit_raw("\\\\");
-        break;
-      case '"':
-        emit_raw("\\\"");
-        break;
-      default:
-        emit_raw("%c", *s);
-        break;
-      }
-    }
-    emit_raw("\")");
-    break;
-  }
-
-  case NODE_BOOL_LITERAL:
-    emit_raw("VAL_INT(%ld)", (long)node->data.bool_literal.value);
+  case NODE_STRING_LITERAL:
+    emit_raw("NH_STR(__str_%d)",
+             string_literal(node->data.string_literal.value));
     break;
 
   case NODE_IDENTIFIER:
-    emit_raw("%s", node->data.identifier.name);
+    if (is_raw_int(node->data.identifier.name))
+      emit_raw("VAL_INT(%s)", node->data.identifier.name);
+    else
+      emit_raw("%s", node->data.identifier.name);
     break;
 
   case NODE_IMPLICIT:
@@ -301,82 +1755,35 @@ static void codegen_expr(ASTNode *node) {
     break;
 
   case NODE_BINARY_OP:
-    // Special handling for comparisons - result is boolean (INT 0 or 1)
-    if (node->data.binary.op >= OP_EQ && node->data.binary.op <= OP_OR) {
-      // Logical/Comparison ops return tagged booleans
-      // Operands for logical ops (AND/OR) are treated as booleans (check != 0)
-      // Operands for comparison ops (EQ/NE/LT...) need AS_INT unless we do
-      // operator overloading For simplicity: Int comparisons
-      if (node->data.binary.op == OP_EQ) {
-        emit_raw("val_eq((");
-        codegen_expr(node->data.binary.left);
-        emit_raw("), (");
-        codegen_expr(node->data.binary.right);
-        emit_raw("))");
-      } else if (node->data.binary.op == OP_NE) {
-        emit_raw("(val_eq((");
-        codegen_expr(node->data.binary.left);
-        emit_raw("), (");
-        codegen_expr(node->data.binary.right);
-        emit_raw(")) == VAL_INT(0) ? VAL_INT(1) : VAL_INT(0))");
-      } else if (node->data.binary.op == OP_AND) {
-        emit_raw("(((");
-        codegen_expr(node->data.binary.left);
-        emit_raw(") != VAL_INT(0)) && ((");
-        codegen_expr(node->data.binary.right);
-        emit_raw(") != VAL_INT(0)) ? VAL_INT(1) : VAL_INT(0))");
-      } else if (node->data.binary.op == OP_OR) {
-        emit_raw("(((");
-        codegen_expr(node->data.binary.left);
-        emit_raw(") != VAL_INT(0)) || ((");
-        codegen_expr(node->data.binary.right);
-        emit_raw(") != VAL_INT(0)) ? VAL_INT(1) : VAL_INT(0))");
-      } else {
-        // Relational ops ( <, >, <=, >= ) assume integers for now
-        emit_raw("VAL_INT(AS_INT(");
-        codegen_expr(node->data.binary.left);
-        emit_raw(") %s AS_INT(", binop_to_c(node->data.binary.op));
-        codegen_expr(node->data.binary.right);
-        emit_raw("))");
-      }
-    } else {
-      // Arithmetic ops ( +, -, *, /, % )
-      // Check if either operand is a float - if so, emit raw operation
-      if (is_float_expr(node->data.binary.left) ||
-          is_float_expr(node->data.binary.right)) {
-        emit_raw("(");
-        codegen_float_operand(node->data.binary.left);
-        emit_raw(" %s ", binop_to_c(node->data.binary.op));
-        codegen_float_operand(node->data.binary.right);
-        emit_raw(")");
-      } else {
-        emit_raw("VAL_INT(AS_INT(");
-        codegen_expr(node->data.binary.left);
-        emit_raw(") %s AS_INT(", binop_to_c(node->data.binary.op));
-        codegen_expr(node->data.binary.right);
-        emit_raw("))");
-      }
-    }
-    break;
-
   case NODE_UNARY_OP:
-    switch (node->data.unary.op) {
-    case OP_NEG:
-      if (is_float_expr(node->data.unary.operand)) {
-        emit_raw("(-");
-        codegen_expr(node->data.unary.operand);
-        emit_raw(")");
-      } else {
-        emit_raw("VAL_INT(-AS_INT(");
-        codegen_expr(node->data.unary.operand);
-        emit_raw("))");
-      }
-      break;
-    case OP_NOT:
-      emit_raw("VAL_INT((");
+    if (is_int_op(node)) {
+      // Computed untagged and tagged once
+      emit_raw("VAL_INT(");
+      codegen_int_op(node);
+      emit_raw(")");
+    } else if (node->type == NODE_UNARY_OP) {
+      emit_raw("(-");
       codegen_expr(node->data.unary.operand);
-      emit_raw(") == VAL_INT(0))");
-      break;
+      emit_raw(")");
+    } else if (node->data.binary.op == OP_EQ) {
+      emit_raw("val_eq((");
+      codegen_expr(node->data.binary.left);
+      emit_raw("), (");
+      codegen_expr(node->data.binary.right);
+      emit_raw("))");
+    } else if (node->data.binary.op == OP_NE) {
+      emit_raw("(val_eq((");
+      codegen_expr(node->data.binary.left);
+      emit_raw("), (");
+      codegen_expr(node->data.binary.right);
+      emit_raw(")) == VAL_INT(0) ? VAL_INT(1) : VAL_INT(0))");
+    } else {
+      // Float arithmetic: a raw operation on doubles
+      emit_raw("(");
+      codegen_float_operand(node->data.binary.left);
+      emit_raw(" %s ", binop_to_c(node->data.binary.op));
+      codegen_float_operand(node->data.binary.right);
+      emit_raw(")");
     }
     break;
 
@@ -393,9 +1800,7 @@ static void codegen_expr(ASTNode *node) {
           if (is_float_expr(arg)) {
             codegen_expr(arg);
           } else {
-            emit_raw("AS_INT(");
-            codegen_expr(arg);
-            emit_raw(")");
+            codegen_int(arg);
           }
         } else {
           codegen_expr(arg);
@@ -407,26 +1812,33 @@ static void codegen_expr(ASTNode *node) {
   }
 
   case NODE_ASSIGN:
-    // Check if assigning to a member
-    if (node->data.assign.target->type == NODE_MEMBER) {
-      emit_raw("ds_object_set(&");
-      codegen_expr(node->data.assign.target->data.member.object);
-      emit_raw(", VAL_OBJ(\"%s\"), ",
-               node->data.assign.target->data.member.member);
-      codegen_expr(node->data.assign.value);
+    if (node->data.assign.target->type == NODE_IDENTIFIER &&
+        is_raw_int(node->data.assign.target->data.identifier.name)) {
+      emit_raw("VAL_INT(");
+      codegen_assign(node->data.assign.target, node->data.assign.value);
       emit_raw(")");
     } else {
-      codegen_expr(node->data.assign.target);
-      emit_raw(" = ");
-      codegen_expr(node->data.assign.value);
+      codegen_assign(node->data.assign.target, node->data.assign.value);
     }
     break;
 
   case NODE_INDEX:
+    if (typed_array_kind(node->data.index.array)) {
+      codegen_typed_load(node, 0);
+      break;
+    }
+    if (typed_kind(node->data.index.array) == TYPED_MAP) {
+      emit_raw("ds_map_get(");
+      codegen_expr(node->data.index.array);
+      emit_raw(", ");
+      codegen_expr(node->data.index.index);
+      emit_raw(")");
+      break;
+    }
     codegen_expr(node->data.index.array);
-    emit_raw("[AS_INT(");
-    codegen_expr(node->data.index.index);
-    emit_raw(")]");
+    emit_raw("[");
+    codegen_int(node->data.index.index);
+    emit_raw("]");
     break;
 
   case NODE_ARRAY:
@@ -451,9 +1863,9 @@ static void codegen_expr(ASTNode *node) {
     break;
 
   case NODE_TERNARY:
-    emit_raw("((");
-    codegen_expr(node->data.ternary.condition);
-    emit_raw(") != VAL_INT(0) ? ");
+    emit_raw("(");
+    codegen_cond(node->data.ternary.condition);
+    emit_raw(" ? ");
     codegen_expr(node->data.ternary.then_expr);
     emit_raw(" : ");
     codegen_expr(node->data.ternary.else_expr);
@@ -476,32 +1888,14 @@ static void codegen_expr(ASTNode *node) {
       snprintf(implicit_name, sizeof(implicit_name), "__match_%d", match_id);
       push_implicit(implicit_name);
 
-      // Generate if-else chain for match arms
       ASTList *arms = node->data.pipe.right->data.match.arms;
-      if (arms) {
-        for (size_t i = 0; i < arms->count; i++) {
-          ASTNode *arm = arms->items[i];
-          ASTNode *pattern = arm->data.match_arm.pattern;
-          ASTNode *body = arm->data.match_arm.body;
-
-          if (i > 0)
-            emit_raw(" else ");
-
-          // Check if pattern is wildcard (_)
-          if (pattern->type == NODE_IMPLICIT) {
-            // Default case - just execute
-            emit_raw("{ __result_%d = ", match_id);
-            codegen_expr(body);
-            emit_raw("; }");
-          } else {
-            // Compare pattern to match value
-            emit_raw("if (__match_%d == ", match_id);
-            codegen_expr(pattern);
-            emit_raw(") { __result_%d = ", match_id);
-            codegen_expr(body);
-            emit_raw("; }");
-          }
-        }
+      if (match_is_switch(arms)) {
+        emit_raw("switch (MATCH_INT(__match_%d)) {", match_id);
+        codegen_match_cases(arms, match_id);
+        codegen_match_chain(arms, match_id, 1);
+        emit_raw(" }");
+      } else {
+        codegen_match_chain(arms, match_id, 0);
       }
 
       pop_implicit();
@@ -595,14 +1989,13 @@ static void codegen_expr(ASTNode *node) {
   } break;
 
   case NODE_OBJECT:
-    // Objects are implemented as a simple struct with string keys
-    // We'll generate a compound literal with the ds_object type
-    emit_raw("ds_object_create(VAL_INT(%zu)",
+    // Objects are runtime handles; keys are passed as pre-interned atoms
+    emit_raw("ds_object_create_atoms(VAL_INT(%zu)",
              node->data.object.fields ? node->data.object.fields->count : 0);
     if (node->data.object.fields) {
       for (size_t i = 0; i < node->data.object.fields->count; i++) {
         ASTNode *field = node->data.object.fields->items[i];
-        emit_raw(", \"%s\", ", field->data.object_field.key);
+        emit_raw(", __atom_%d, ", member_atom(field->data.object_field.key));
         codegen_expr(field->data.object_field.value);
       }
     }
@@ -615,10 +2008,14 @@ static void codegen_expr(ASTNode *node) {
     break;
 
   case NODE_MEMBER:
-    // Member access: obj.field becomes ds_object_get(obj, (Value)"field")
-    emit_raw("ds_object_get(");
-    codegen_expr(node->data.member.object);
-    emit_raw(", VAL_OBJ(\"%s\"))", node->data.member.member);
+    // Member access: obj.field becomes an inline-cached ds_object_get_ic
+    {
+      int ic = prop_cache_counter++;
+      emit_raw("({ static PropCache __ic_%d; ds_object_get_ic(", ic);
+      codegen_expr(node->data.member.object);
+      emit_raw(", __atom_%d, &__ic_%d); })",
+               member_atom(node->data.member.member), ic);
+    }
     break;
 
   default:
@@ -644,10 +2041,22 @@ static void codegen_stmt(ASTNode *node) {
     emit("}\n");
     break;
 
-  case NODE_VAR_DECL:
+  case NODE_VAR_DECL: {
+    LocalInfo *local = find_local(node->data.var_decl.name);
+    if (local && local->heap) {
+      // Hoisted into the frame (see emit_frame_enter)
+      emit("%s = ", node->data.var_decl.name);
+      codegen_expr(node->data.var_decl.init);
+      emit_raw(";\n");
+      break;
+    }
     // Detect type from initializer
-    if (node->data.var_decl.init &&
-        node->data.var_decl.init->type == NODE_ARRAY) {
+    if (is_raw_int(node->data.var_decl.name)) {
+      emit("long %s = ", node->data.var_decl.name);
+      codegen_int(node->data.var_decl.init);
+      emit_raw(";\n");
+    } else if (node->data.var_decl.init &&
+               node->data.var_decl.init->type == NODE_ARRAY) {
       emit("long %s[16384] = ", node->data.var_decl.name);
       codegen_expr(node->data.var_decl.init);
       emit_raw(";\n");
@@ -663,7 +2072,7 @@ static void codegen_stmt(ASTNode *node) {
       // Strings are stored as Value (pointer cast to long) for consistency
       emit("Value %s = ", node->data.var_decl.name);
       codegen_expr(
-          node->data.var_decl.init); // codegen_expr now emits VAL_OBJ("...")
+          node->data.var_decl.init); // codegen_expr emits NH_STR(__str_N)
       emit_raw(";\n");
     } else if (node->data.var_decl.init &&
                node->data.var_decl.init->type == NODE_OBJECT) {
@@ -676,30 +2085,19 @@ static void codegen_stmt(ASTNode *node) {
       emit_raw(";\n");
     }
     break;
+  }
 
   case NODE_ASSIGN:
     emit("");
-    // Check if assigning to a member
-    if (node->data.assign.target->type == NODE_MEMBER) {
-      emit_raw("ds_object_set(&");
-      codegen_expr(node->data.assign.target->data.member.object);
-      emit_raw(", VAL_OBJ(\"%s\"), ",
-               node->data.assign.target->data.member.member);
-      codegen_expr(node->data.assign.value);
-      emit_raw(");\n");
-    } else {
-      codegen_expr(node->data.assign.target);
-      emit_raw(" = ");
-      codegen_expr(node->data.assign.value);
-      emit_raw(";\n");
-    }
+    codegen_assign(node->data.assign.target, node->data.assign.value);
+    emit_raw(";\n");
     break;
 
   case NODE_LOOP:
     if (node->data.loop.condition) {
-      emit("while ((");
-      codegen_expr(node->data.loop.condition);
-      emit_raw(") != VAL_INT(0)) ");
+      emit("while (");
+      codegen_cond(node->data.loop.condition);
+      emit_raw(") ");
     } else {
       emit("while (1) ");
     }
@@ -743,30 +2141,15 @@ static void codegen_stmt(ASTNode *node) {
     break;
 
   case NODE_RETURN:
-    if (in_main) {
-      // main() should return raw int for proper exit code
-      emit("return AS_INT(");
-      if (node->data.return_stmt.value) {
-        codegen_expr(node->data.return_stmt.value);
-      } else {
-        emit_raw("0");
-      }
-      emit_raw(");\n");
-    } else {
-      emit("return");
-      if (node->data.return_stmt.value) {
-        emit_raw(" ");
-        codegen_expr(node->data.return_stmt.value);
-      }
-      emit_raw(";\n");
-    }
+    // main() should return raw int for proper exit code
+    codegen_return(node->data.return_stmt.value, in_main);
     break;
 
   case NODE_BREAK:
     if (node->data.break_stmt.condition) {
-      emit("if ((");
-      codegen_expr(node->data.break_stmt.condition);
-      emit_raw(") != VAL_INT(0)) break;\n");
+      emit("if (");
+      codegen_cond(node->data.break_stmt.condition);
+      emit_raw(") break;\n");
     } else {
       emit("break;\n");
     }
@@ -777,15 +2160,9 @@ static void codegen_stmt(ASTNode *node) {
     break;
 
   case NODE_WHEN_STMT:
-    if (node->data.when_stmt.is_unless) {
-      emit("if ((");
-      codegen_expr(node->data.when_stmt.condition);
-      emit_raw(") == VAL_INT(0)) {\n");
-    } else {
-      emit("if ((");
-      codegen_expr(node->data.when_stmt.condition);
-      emit_raw(") != VAL_INT(0)) {\n");
-    }
+    emit(node->data.when_stmt.is_unless ? "if (!" : "if (");
+    codegen_cond(node->data.when_stmt.condition);
+    emit_raw(") {\n");
     indent_level++;
     // Inline the action
     if (node->data.when_stmt.action->type == NODE_BLOCK) {
@@ -804,12 +2181,9 @@ static void codegen_stmt(ASTNode *node) {
     } else if (node->data.when_stmt.action->type == NODE_CONTINUE) {
       emit("continue;\n");
     } else if (node->data.when_stmt.action->type == NODE_RETURN) {
-      emit("return");
-      if (node->data.when_stmt.action->data.return_stmt.value) {
-        emit_raw(" ");
-        codegen_expr(node->data.when_stmt.action->data.return_stmt.value);
-      }
-      emit_raw(";\n");
+      codegen_return(node->data.when_stmt.action->data.return_stmt.value, 0);
+    } else if (node->data.when_stmt.action->type == NODE_ASSIGN) {
+      codegen_stmt(node->data.when_stmt.action);
     } else {
       emit("");
       codegen_expr(node->data.when_stmt.action);
@@ -820,6 +2194,11 @@ static void codegen_stmt(ASTNode *node) {
     break;
 
   case NODE_EXPR_STMT:
+    if (node->data.expr_stmt.expr &&
+        node->data.expr_stmt.expr->type == NODE_ASSIGN) {
+      codegen_stmt(node->data.expr_stmt.expr); // No need to tag the result
+      break;
+    }
     emit("");
     codegen_expr(node->data.expr_stmt.expr);
     emit_raw(";\n");
@@ -854,6 +2233,8 @@ static void codegen_function(ASTNode *func) {
   const char *name = func->data.function.name;
   int is_main = (strcmp(name, "main") == 0);
   int is_game_init = (strcmp(name, "game_init") == 0);
+  // Program entry points register GC roots and intern member atoms first
+  int is_entry = is_main || is_game_init;
   in_main = is_main;
 
   const char *ret_type =
@@ -875,39 +2256,29 @@ static void codegen_function(ASTNode *func) {
     emit_raw("void");
   }
 
-  emit_raw(") ");
-
-  if (func->data.function.body->type == NODE_RETURN) {
-    emit_raw("{\n");
-    indent_level++;
-    // Inject GC root registration at start of game_init
-    if (is_game_init) {
-      emit("__gc_register_roots();\n");
+  emit_raw(") {\n");
+  indent_level++;
+  // Inject GC root registration at start of the entry point
+  if (is_entry) {
+    emit("__gc_register_roots();\n");
+  }
+  ASTNode *body = func->data.function.body;
+  prepare_locals(params, body);
+  emit_frame_enter(params, NULL);
+  if (body->type == NODE_BLOCK) {
+    for (size_t i = 0;
+         body->data.block.statements && i < body->data.block.statements->count;
+         i++) {
+      codegen_stmt(body->data.block.statements->items[i]);
     }
-    codegen_stmt(func->data.function.body);
-    indent_level--;
-    emit("}\n");
   } else {
-    // For block bodies, inject after opening brace
-    if (is_game_init && func->data.function.body->type == NODE_BLOCK) {
-      emit("{\n");
-      indent_level++;
-      emit("__gc_register_roots();\n");
-      // Emit block contents
-      if (func->data.function.body->data.block.statements) {
-        for (size_t i = 0;
-             i < func->data.function.body->data.block.statements->count; i++) {
-          codegen_stmt(
-              func->data.function.body->data.block.statements->items[i]);
-        }
-      }
-      indent_level--;
-      emit("}\n");
-    } else {
-      codegen_stmt(func->data.function.body);
-    }
+    codegen_stmt(body);
   }
-  emit_raw("\n");
+  if (!ends_in_return(body))
+    emit_frame_exit();
+  frame_active = 0;
+  indent_level--;
+  emit("}\n\n");
 }
 
 static void codegen_global_var(ASTNode *node) {
@@ -941,7 +2312,10 @@ static void codegen_global_var(ASTNode *node) {
     emit("long %s = ", node->data.var_decl.name);
     codegen_expr(node->data.var_decl.init);
     emit_raw(";\n");
-    collect_gc_root_value(node->data.var_decl.name);
+    // A constant is folded into its uses, and is never a heap value
+    ConstantInfo *info = find_constant(node->data.var_decl.name);
+    if (!info || info->state != CONST_FOLDED)
+      collect_gc_root_value(node->data.var_decl.name);
   }
 }
 
@@ -969,6 +2343,9 @@ static void emit_lambdas(void) {
     emit_raw(") {\n");
     indent_level++;
 
+    int has_params = lambda->params && lambda->params->count > 0;
+    prepare_locals(lambda->params, lambda->body);
+    emit_frame_enter(lambda->params, has_params ? NULL : "_");
     if (lambda->body->type == NODE_BLOCK) {
       // Block body
       if (lambda->body->data.block.statements) {
@@ -979,10 +2356,11 @@ static void emit_lambdas(void) {
       }
     } else {
       // Expression body
-      emit("return ");
-      codegen_expr(lambda->body);
-      emit_raw(";\n");
+      codegen_return(lambda->body, 0);
     }
+    if (lambda->body->type == NODE_BLOCK && !ends_in_return(lambda->body))
+      emit_frame_exit();
+    frame_active = 0;
 
     indent_level--;
     emit("}\n\n");
@@ -1021,12 +2399,15 @@ void codegen(ASTNode *root, FILE *output) {
   indent_level = 0;
   temp_counter = 0;
   lambda_counter = 0;
+  prop_cache_counter = 0;
   collected_lambda_count = 0;
   implicit_depth = 0;
 
   // Reset GC root tracking
   gc_root_array_count = 0;
   gc_root_value_count = 0;
+  member_atom_count = 0;
+  string_literal_count = 0;
 
   // Emit header
   fprintf(out, "// Generated by nh compiler\n");
@@ -1034,29 +2415,95 @@ void codegen(ASTNode *root, FILE *output) {
 
   if (root && root->type == NODE_PROGRAM && root->data.program.decls) {
     ASTList *decls = root->data.program.decls;
-
-    // First pass: emit global variables (this collects GC roots)
+    program_decls = decls;
+    find_typed_globals(decls);
+    find_constants(decls);
+
+    // Globals and function bodies are generated into buffers first: the
+    // member atoms they reference are only known once they've been walked,
+    // and must be declared ahead of them.
+    FILE *final_out = out;
+    char *globals_buf = NULL, *body_buf = NULL;
+    size_t globals_len = 0, body_len = 0;
+
+    // First pass: global variables (this collects GC roots)
+    out = open_memstream(&globals_buf, &globals_len);
     for (size_t i = 0; i < decls->count; i++) {
       if (decls->items[i]->type == NODE_VAR_DECL) {
         codegen_global_var(decls->items[i]);
       }
     }
+    fclose(out);
+
+    // Second pass: function definitions and any collected lambdas
+    out = open_memstream(&body_buf, &body_len);
+    for (size_t i = 0; i < decls->count; i++) {
+      if (decls->items[i]->type == NODE_FUNCTION) {
+        codegen_function(decls->items[i]);
+      }
+    }
+    if (collected_lambda_count > 0) {
+      fprintf(out, "// Lambda functions\n");
+      emit_lambdas();
+    }
+    fclose(out);
+    out = final_out;
+
+    if (member_atom_count > 0) {
+      fprintf(out, "// Member-name atoms (interned in __gc_register_roots)\n");
+      for (int i = 0; i < member_atom_count; i++) {
+        fprintf(out, "static int __atom_%d; // %s\n", i, member_atoms[i]);
+      }
+      fprintf(out, "\n");
+    }
+
+    if (string_literal_count > 0) {
+      fprintf(out, "// String literals\n");
+      for (int i = 0; i < string_literal_count; i++) {
+        const char *lit = string_literals[i];
+        fprintf(out, "NH_STR_DEF(__str_%d, %zu, 0x%08xu, ", i, strlen(lit),
+                string_hash(lit));
+        write_c_string(out, lit);
+        fprintf(out, ");\n");
+      }
+      fprintf(out, "\n");
+    }
+
+    fwrite(globals_buf, 1, globals_len, out);
+    free(globals_buf);
     fprintf(out, "\n");
 
+    if (gc_root_array_count > 0) {
+      fprintf(out, "// Root array ids (for GC_WB_ROOT)\n");
+      for (int i = 0; i < gc_root_array_count; i++) {
+        fprintf(out, "static int __root_%d = -1; // %s\n", i,
+                gc_root_arrays[i].name);
+      }
+      fprintf(out, "\n");
+    }
+
     // Emit GC root registration function
     fprintf(out, "// GC root registration (auto-generated)\n");
     fprintf(out, "static void __gc_register_roots(void) {\n");
     for (int i = 0; i < gc_root_array_count; i++) {
-      fprintf(out, "    gc_register_root_array(%s, 16384);\n",
+      fprintf(out, "    __root_%d = gc_register_root_array(%s, 16384);\n", i,
               gc_root_arrays[i].name);
     }
     for (int i = 0; i < gc_root_value_count; i++) {
       fprintf(out, "    gc_register_root_value(&%s);\n",
               gc_root_values[i].name);
     }
+    // Literals first, so each becomes the canonical copy of its chars
+    for (int i = 0; i < string_literal_count; i++) {
+      fprintf(out, "    ds_intern_literal(NH_STR(__str_%d));\n", i);
+    }
+    for (int i = 0; i < member_atom_count; i++) {
+      fprintf(out, "    __atom_%d = ds_atom_intern(\"%s\");\n", i,
+              member_atoms[i]);
+    }
     fprintf(out, "}\n\n");
 
-    // Second pass: emit forward declarations for all functions
+    // Forward declarations for all functions
     fprintf(out, "// Forward declarations\n");
     for (size_t i = 0; i < decls->count; i++) {
       if (decls->items[i]->type == NODE_FUNCTION) {
@@ -1065,17 +2512,7 @@ void codegen(ASTNode *root, FILE *output) {
     }
     fprintf(out, "\n");
 
-    // Third pass: emit function definitions
-    for (size_t i = 0; i < decls->count; i++) {
-      if (decls->items[i]->type == NODE_FUNCTION) {
-        codegen_function(decls->items[i]);
-      }
-    }
-
-    // Emit any collected lambdas
-    if (collected_lambda_count > 0) {
-      fprintf(out, "// Lambda functions\n");
-      emit_lambdas();
-    }
+    fwrite(body_buf, 1, body_len, out);
+    free(body_buf);
   }
 }
@@ -8,8 +8,10 @@
 #else
 #include <GL/glut.h>
 #endif
+#include <limits.h>
 #include <math.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,34 +22,140 @@
 // Garbage Collector
 // ============================================================================
 
-// Type Masks for Handles (Distinguish Integers from Handles)
-// 0x10000000 = Object Handle (Bit 28)
-// 0x20000000 = List Handle (Bit 29)
-// These bits are safe in signed 32-bit positive integers even after << 1
-// tagging
-#define TYPE_MASK_OBJ 0x10000000
-#define TYPE_MASK_LIST 0x20000000
-
-#define GC_MAX_ALLOCATIONS 131072 // Max tracked allocations
-
 typedef enum {
   GC_TYPE_STRING,      // Heap-allocated string
   GC_TYPE_LIST_ITEMS,  // List items array
-  GC_TYPE_FLOAT_BUFFER // Float buffer data
+  GC_TYPE_FLOAT_BUFFER, // Float buffer data
+  GC_TYPE_ARRAY,       // Typed array (header and elements)
+  GC_TYPE_MAP,         // Map hash table (header and entries)
+  GC_TYPE_COUNT
 } GcAllocType;
 
-typedef struct {
-  void *ptr;        // Pointer to allocated memory
-  GcAllocType type; // Type of allocation
-  int marked;       // Mark bit for current GC cycle
-  int in_use;       // Is this slot in use?
-} GcAllocation;
-
-static GcAllocation gc_allocations[GC_MAX_ALLOCATIONS];
 static int gc_initialized = 0;
-static int gc_allocation_count = 0;
-static int gc_threshold = 1000;    // Trigger GC after this many allocations
-static int gc_next_alloc_slot = 0; // Cursor for next-fit allocation
+static int gc_allocation_count = 0; // Live heap blocks
+
+// Collection is incremental: a cycle is spread over frames by on_frame_start,
+// at most gc_frame_budget_us of marking and sweeping per frame (see the Mark
+// and Sweep section). Marks are epochs rather than bits - something is marked
+// iff its mark equals gc_epoch - so nothing needs clearing between cycles.
+typedef enum { GC_IDLE, GC_MARK, GC_SWEEP } GcPhase;
+
+static GcPhase gc_phase = GC_IDLE;
+static uint8_t gc_epoch = 1;      // 1..255; 0 is the mark of idle allocations
+static uint8_t gc_alloc_mark = 0; // gc_epoch mid-cycle: new blocks start black
+static long gc_frame_budget_us = 1000;
+int gc_marking = 0; // Write barrier armed (see GC_WB in runtime.h)
+
+static inline void gc_write_barrier(Value val) {
+  if (gc_marking)
+    gc_shade(val);
+}
+
+// Generations, without moving anything ("sticky" marks): between cycles,
+// whatever survived a collection carries gc_epoch and is old, and whatever
+// was allocated since carries 0 and is young. A minor collection marks the
+// young reachable from the roots and the remembered set with gc_epoch, which
+// promotes them, and frees the rest of the nursery. The nursery is found
+// through the young logs below rather than by sweeping, so a minor costs
+// what was allocated since the last one, not the size of the heap. Old
+// containers stored into are remembered, and so are the global array slots
+// written (GC_WB_AT); single globals and the exec stack are cheap enough to
+// rescan every time. Majors (the incremental cycle) start from the old
+// generation's growth, checked after each minor.
+#define GC_LOG_MAX 262144 // Cap on any one log (a program may never reach
+                          // on_frame_start)
+
+typedef struct {
+  uintptr_t *items;
+  int count;
+  int capacity;
+} GcLog;
+
+static GcLog gc_young_cells;   // Small heap cells (GcHeader *)
+static GcLog gc_young_objects; // Object indices
+static GcLog gc_young_lists;   // List indices
+static GcLog gc_remembered;    // Old objects/lists stored into (handles)
+static GcLog gc_root_slots;    // Global array slots written (Value *)
+static int gc_young_large = 0; // Large blocks aren't logged, just counted
+static int gc_nursery_lost = 0;   // A young log overflowed: next is a major
+static int gc_root_slots_lost = 0; // Slot log overflowed: rescan root arrays
+
+static int gc_log_push(GcLog *log, uintptr_t item) {
+  if (log->count == log->capacity) {
+    int capacity = log->capacity ? log->capacity * 2 : 1024;
+    uintptr_t *grown = capacity <= GC_LOG_MAX
+                           ? realloc(log->items, capacity * sizeof(uintptr_t))
+                           : NULL;
+    if (!grown)
+      return 0;
+    log->items = grown;
+    log->capacity = capacity;
+  }
+  log->items[log->count++] = item;
+  return 1;
+}
+
+// Record a young allocation (nothing to do mid-cycle: those start black)
+static inline void gc_log_young(GcLog *log, uintptr_t item) {
+  if (gc_phase == GC_IDLE && !gc_nursery_lost && !gc_log_push(log, item))
+    gc_nursery_lost = 1;
+}
+
+// Triggering is by bytes, not block counts: heap blocks count their cell
+// (or malloc'd) size, objects and lists their table slot. A minor runs once
+// gc_nursery_limit bytes have been allocated since the last collection, and a
+// major once the heap outgrows gc_major_trigger. Both adapt to how much the
+// previous collection of their kind kept (see gc_adapt_nursery and
+// gc_end_cycle); gc_set_heap_growth and gc_set_nursery_size tune them.
+#define GC_NURSERY_BYTES (1024 * 1024) // Default nursery
+#define GC_NURSERY_MIN (64 * 1024)
+#define GC_NURSERY_MAX (4 * 1024 * 1024) // 16-byte cells fill GC_LOG_MAX
+#define GC_MIN_HEAP (1024 * 1024)        // No major below this
+#define GC_IDLE_FRAMES 300 // Frames before a minor of a barely used nursery
+
+static size_t gc_heap_bytes = 0;    // Live, plus allocated since collected
+static size_t gc_nursery_bytes = 0; // Allocated since the last collection
+static size_t gc_nursery_base = GC_NURSERY_BYTES; // As tuned
+static size_t gc_nursery_limit = GC_NURSERY_BYTES; // As adapted
+static size_t gc_major_trigger = GC_MIN_HEAP;
+static size_t gc_cycle_start_bytes = 0; // Heap size when the major began
+static size_t gc_cycle_live_bytes = 0;  // And when it ended
+static double gc_survivor_ratio = 1.0;  // Of the last major
+static long gc_heap_growth = 100; // Percent of the survivors (tunable)
+static int gc_idle_frames = 0;    // Frames since the last collection
+
+static inline void gc_account_alloc(size_t bytes) {
+  gc_heap_bytes += bytes;
+  if (gc_phase == GC_IDLE)
+    gc_nursery_bytes += bytes;
+}
+
+static inline void gc_account_free(size_t bytes) { gc_heap_bytes -= bytes; }
+
+// Telemetry (see GcStats in runtime.h). Pauses are timed by gc_maybe_collect
+// and gc_force_collect; the rest is counted where it happens.
+static const long gc_pause_limits_us[GC_PAUSE_BUCKETS - 1] = {
+    50, 100, 250, 500, 1000, 2500, 5000};
+
+static GcStats gc_stats;
+static size_t gc_type_bytes[GC_TYPE_COUNT]; // Live heap bytes per type
+
+static void gc_record_pause(long us) {
+  int b = 0;
+  while (b < GC_PAUSE_BUCKETS - 1 && us >= gc_pause_limits_us[b])
+    b++;
+  gc_stats.pauses[b]++;
+  gc_stats.pause_last_us = us;
+  gc_stats.pause_total_us += us;
+  if (us > gc_stats.pause_max_us)
+    gc_stats.pause_max_us = us;
+}
+
+// A handle table or the float buffers are full: say so once, count always
+static void gc_alloc_failed(const char *what) {
+  if (gc_stats.alloc_failures++ == 0)
+    printf("[GC ERROR] %s exhausted; creation returned 0\n", what);
+}
 
 // IMPORTANT: GC requires roots to be registered. Compiled nh code stores
 // strings in C global variables and arrays. These MUST be registered via
@@ -56,9 +164,14 @@ static int gc_next_alloc_slot = 0; // Cursor for next-fit allocation
 // Root array registry - for arrays like editor_lines[]
 #define GC_MAX_ROOT_ARRAYS 1024
 
+// Compiled code declares every global array with 16384 elements, and most use
+// a handful, so each keeps a high-water mark: the collector scans only
+// [0, used), which covers every reference ever stored (GC_WB_ROOT/GC_WB_AT
+// raise it, gc_clear_array drops it back to 0).
 typedef struct {
   Value *array; // Pointer to array start
   int size;     // Number of elements
+  int used;     // High-water mark: past the last slot given a reference
   int in_use;
 } GcRootArray;
 
@@ -70,16 +183,40 @@ static GcRootArray gc_root_arrays[GC_MAX_ROOT_ARRAYS];
 static Value *gc_root_values[GC_MAX_ROOT_VALUES];
 static int gc_root_value_count = 0;
 
-// Register an array as a GC root (called from generated code)
-void gc_register_root_array(Value *array, int size) {
+// Register an array as a GC root (called from generated code); returns its
+// id for GC_WB_ROOT, or -1 if the registry is full
+int gc_register_root_array(Value *array, int size) {
   for (int i = 0; i < GC_MAX_ROOT_ARRAYS; i++) {
     if (!gc_root_arrays[i].in_use) {
+      // Start the mark past whatever it already holds
+      int used = size;
+      while (used > 0 && !GC_IS_REF(array[used - 1]))
+        used--;
       gc_root_arrays[i].array = array;
       gc_root_arrays[i].size = size;
+      gc_root_arrays[i].used = used;
       gc_root_arrays[i].in_use = 1;
-      return;
+      return i;
     }
   }
+  printf("[GC ERROR] gc_register_root_array: capacity exceeded! Max=%d\n",
+         GC_MAX_ROOT_ARRAYS);
+  return -1;
+}
+
+// The registered array holding slot, or NULL
+static GcRootArray *gc_root_array_of(Value *slot) {
+  for (int i = 0; i < GC_MAX_ROOT_ARRAYS && gc_root_arrays[i].in_use; i++) {
+    if (slot >= gc_root_arrays[i].array &&
+        slot < gc_root_arrays[i].array + gc_root_arrays[i].size)
+      return &gc_root_arrays[i];
+  }
+  return NULL;
+}
+
+static inline void gc_root_array_raise(GcRootArray *root, long index) {
+  if (index >= root->used && index < root->size)
+    root->used = (int)index + 1;
 }
 
 // Register a single value as a GC root (called from generated code)
@@ -92,6 +229,42 @@ void gc_register_root_value(Value *value_ptr) {
   }
 }
 
+static void gc_log_root_store(Value *slot, Value val) {
+  if (gc_marking)
+    gc_shade(val);
+  else if (gc_phase == GC_IDLE && !gc_root_slots_lost &&
+           !gc_log_push(&gc_root_slots, (uintptr_t)slot))
+    gc_root_slots_lost = 1;
+}
+
+// Barrier for a reference stored into a root array element (GC_WB_ROOT):
+// raise the array's mark, then shade the value while marking, otherwise log
+// the slot so the next minor collection looks at it
+void gc_write_root_at(int root, long index, Value val) {
+  if (root < 0 || root >= GC_MAX_ROOT_ARRAYS)
+    return;
+  gc_root_array_raise(&gc_root_arrays[root], index);
+  gc_log_root_store(&gc_root_arrays[root].array[index], val);
+}
+
+// As gc_write_root_at, for a slot known only by address (GC_WB_AT)
+void gc_write_root(Value *slot, Value val) {
+  GcRootArray *root = gc_root_array_of(slot);
+  if (root)
+    gc_root_array_raise(root, slot - root->array);
+  gc_log_root_store(slot, val);
+}
+
+// Log `slot` if it lies in a root array: for stores the runtime makes through
+// a Value * it was handed, which may or may not point at a global
+static void gc_note_root_store(Value *slot) {
+  GcRootArray *root = gc_root_array_of(slot);
+  if (root && GC_IS_REF(*slot)) {
+    gc_root_array_raise(root, slot - root->array);
+    gc_log_root_store(slot, *slot);
+  }
+}
+
 // ============================================================================
 // Execution Stack Protection
 // Protects temporary environments (e.g., function call envs) during execution
@@ -105,6 +278,7 @@ static int gc_exec_stack_depth = 0;
 // Push an environment onto the execution stack to protect it from GC
 void gc_push_env(Value env) {
   if (gc_exec_stack_depth < GC_MAX_EXEC_STACK) {
+    gc_write_barrier(env);
     gc_exec_stack[gc_exec_stack_depth++] = env;
   }
 }
@@ -119,199 +293,429 @@ void gc_pop_env(void) {
 // Clear the execution stack (call when interpreter stops)
 void gc_clear_exec_stack(void) { gc_exec_stack_depth = 0; }
 
+// Innermost frame of compiled code's shadow stack (GC_FRAME in runtime.h).
+// Like the exec stack it isn't behind a write barrier: it's rescanned at the
+// start of every minor and at both ends of a major's marking.
+GcFrame *gc_frame_top = NULL;
+
 // Clear a root array (set all elements to 0 so GC can collect old objects)
 void gc_clear_array(Value *array, Value size_val) {
   int size = AS_INT(size_val);
   for (int i = 0; i < size; i++) {
     array[i] = 0;
   }
+  GcRootArray *root = size > 0 ? gc_root_array_of(array) : NULL;
+  if (root && root->array == array && size >= root->used)
+    root->used = 0;
 }
 
-static void gc_init(void) {
-  if (gc_initialized)
-    return;
-  memset(gc_allocations, 0, sizeof(gc_allocations));
-  gc_initialized = 1;
-}
-
-// Forward declarations for hash table (defined after gc_alloc)
-static void gc_hash_insert(void *ptr, int slot);
-static void gc_hash_remove(void *ptr);
-
-// Register an allocation with the GC
-static void *gc_alloc(size_t size, GcAllocType type) {
-  gc_init();
-
-  void *ptr = malloc(size);
-  if (!ptr)
-    return NULL;
-
-  // Find a free slot (Next Fit strategy for O(1) amortized)
-  int start_slot = gc_next_alloc_slot;
-  int i = start_slot;
-
-  do {
-    if (!gc_allocations[i].in_use) {
-      gc_allocations[i].ptr = ptr;
-      gc_allocations[i].type = type;
-      gc_allocations[i].marked = 0;
-      gc_allocations[i].in_use = 1;
-      gc_allocation_count++;
-      gc_hash_insert(ptr, i); // Add to hash table
-
-      // Update cursor for next time
-      gc_next_alloc_slot = (i + 1) % GC_MAX_ALLOCATIONS;
-      return ptr;
-    }
-    i = (i + 1) % GC_MAX_ALLOCATIONS;
-  } while (i != start_slot);
-
-  // No slots available, just leak (safety over efficiency)
-  return ptr;
+Value gc_root_array_used(Value *array) {
+  GcRootArray *root = gc_root_array_of(array);
+  return VAL_INT(root ? root->used : 0);
 }
 
 // ============================================================================
-// Hash table for fast pointer -> slot lookup
+// Heap: Segregated Size-Class Arena
+// Every GC allocation is preceded by an 8-byte GcHeader carrying its type and
+// mark. Small allocations come from 64 KB chunks (aligned to 64 KB), each
+// carved into equal cells of one size class. Freed cells go on their chunk's
+// own free list and each class keeps an allocation cursor into its chunks, so
+// allocation is a list pop or a bump; per-chunk lists let the incremental
+// sweep rebuild one chunk at a time and still hand empty chunks back. Anything
+// too big for a class gets its own malloc'd block. Chunk bases and large
+// blocks are kept in a hash set, which is how marking tells a heap pointer
+// from, say, a string literal: mask to the chunk base, probe, then check the
+// cell boundary.
 // ============================================================================
 
-#define GC_HASH_SIZE 262144 // Must be power of 2, and > GC_MAX_ALLOCATIONS
+#define GC_CHUNK_SIZE 65536 // Power of 2; small chunks are aligned to it
+#define GC_NUM_CLASSES 12
+#define GC_LARGE_CLASS 0xFF
+#define GC_TYPE_FREE 0xFF // Header type of a cell on a free list
 
-typedef struct {
-  void *ptr;
-  int slot;
-} GcHashEntry;
+// Cell sizes, header included. Multiples of 8 so payloads stay 8-aligned.
+static const uint32_t gc_class_sizes[GC_NUM_CLASSES] = {
+    16, 24, 32, 48, 64, 96, 128, 256, 512, 1024, 2048, 4096};
+#define GC_MAX_SMALL 4096
 
-static GcHashEntry gc_hash_table[GC_HASH_SIZE];
-static int gc_hash_initialized = 0;
+typedef struct {
+  uint32_t size;      // Payload bytes requested
+  uint8_t type;       // GcAllocType, or GC_TYPE_FREE
+  uint8_t marked;     // Epoch of the last cycle that reached it
+  uint8_t size_class; // Index into gc_class_sizes, or GC_LARGE_CLASS
+  uint8_t unused;
+} GcHeader;
+
+typedef struct GcChunk {
+  struct GcChunk *next;  // Next chunk of the same class
+  GcHeader *free_cells;  // Free cells of this chunk; next link in the payload
+  uint32_t cell_size;
+  uint32_t cell_count;    // Cells carved so far (bump pointer)
+  uint32_t cell_capacity; // Cells that fit in the chunk
+  int size_class;
+} GcChunk;
+
+// Cells start after the chunk header, rounded so they stay 8-aligned
+#define GC_CHUNK_HEADER ((sizeof(GcChunk) + 15) & ~(size_t)15)
+
+typedef struct GcLarge {
+  struct GcLarge *next;
+  struct GcLarge *prev;
+  GcHeader header; // Immediately followed by the payload
+} GcLarge;
+
+static GcChunk *gc_chunks[GC_NUM_CLASSES];      // All chunks, per class
+static GcChunk *gc_alloc_chunk[GC_NUM_CLASSES]; // Allocation cursor
+static GcLarge *gc_large_list = NULL;
+static uint8_t gc_class_lookup[GC_MAX_SMALL / 8 + 1]; // (bytes+7)/8 -> class
+
+// Incremental sweep progress through the heap
+static int gc_sweep_class = 0;
+static GcChunk **gc_sweep_link = NULL; // Link to the next chunk to sweep
+static GcLarge *gc_sweep_large = NULL; // Next large block to sweep
+
+// --- Region set: chunk base -> GcChunk, large payload -> GcLarge -----------
 
-static void gc_hash_init(void) {
-  if (gc_hash_initialized)
-    return;
-  memset(gc_hash_table, 0, sizeof(gc_hash_table));
-  gc_hash_initialized = 1;
-}
-
-static unsigned int gc_hash_ptr(void *ptr) {
-  // Better mixing function for pointer hashing
-  uintptr_t x = (uintptr_t)ptr;
-  x = (x ^ (x >> 16)) * 0x45d9f3b;
-  x = (x ^ (x >> 16)) * 0x45d9f3b;
-  x = x ^ (x >> 16);
-  return (unsigned int)(x & (GC_HASH_SIZE - 1));
-}
-
-static void gc_hash_insert(void *ptr, int slot) {
-  gc_hash_init();
-  unsigned int h = gc_hash_ptr(ptr);
-  // Linear probing
-  for (int i = 0; i < GC_HASH_SIZE; i++) {
-    unsigned int idx = (h + i) & (GC_HASH_SIZE - 1);
-    if (gc_hash_table[idx].ptr == NULL || gc_hash_table[idx].ptr == ptr) {
-      gc_hash_table[idx].ptr = ptr;
-      gc_hash_table[idx].slot = slot;
-      return;
-    }
+typedef struct {
+  uintptr_t key; // 0 = empty
+  void *region;
+  int is_large;
+} GcRegionEntry;
+
+static GcRegionEntry *gc_regions = NULL;
+static size_t gc_region_size = 0; // Power of 2
+static size_t gc_region_used = 0;
+
+static size_t gc_region_hash(uintptr_t key) {
+  uint64_t x = (uint64_t)key;
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  return (size_t)x;
+}
+
+static int gc_region_insert(uintptr_t key, void *region, int is_large);
+
+static int gc_region_grow(void) {
+  GcRegionEntry *old = gc_regions;
+  size_t old_size = gc_region_size;
+  size_t new_size = old_size ? old_size * 2 : 256;
+  GcRegionEntry *grown = calloc(new_size, sizeof(GcRegionEntry));
+  if (!grown)
+    return 0;
+  gc_regions = grown;
+  gc_region_size = new_size;
+  gc_region_used = 0;
+  for (size_t i = 0; i < old_size; i++) {
+    if (old[i].key)
+      gc_region_insert(old[i].key, old[i].region, old[i].is_large);
+  }
+  free(old);
+  return 1;
+}
+
+static int gc_region_insert(uintptr_t key, void *region, int is_large) {
+  if ((gc_region_used + 1) * 2 > gc_region_size && !gc_region_grow())
+    return 0;
+  size_t mask = gc_region_size - 1;
+  size_t i = gc_region_hash(key) & mask;
+  while (gc_regions[i].key)
+    i = (i + 1) & mask;
+  gc_regions[i].key = key;
+  gc_regions[i].region = region;
+  gc_regions[i].is_large = is_large;
+  gc_region_used++;
+  return 1;
+}
+
+static GcRegionEntry *gc_region_find(uintptr_t key) {
+  if (!gc_region_size)
+    return NULL;
+  size_t mask = gc_region_size - 1;
+  size_t i = gc_region_hash(key) & mask;
+  while (gc_regions[i].key) {
+    if (gc_regions[i].key == key)
+      return &gc_regions[i];
+    i = (i + 1) & mask;
   }
-  // Hash table full - shouldn't happen if GC_HASH_SIZE >= GC_MAX_ALLOCATIONS
+  return NULL;
 }
 
-static void gc_hash_remove(void *ptr) {
-  unsigned int h = gc_hash_ptr(ptr);
-  int found_idx = -1;
-  for (int i = 0; i < GC_HASH_SIZE; i++) {
-    unsigned int idx = (h + i) & (GC_HASH_SIZE - 1);
-    if (gc_hash_table[idx].ptr == ptr) {
-      found_idx = idx;
+// Linear-probing delete: shift later entries of the cluster back into the gap
+static void gc_region_remove(uintptr_t key) {
+  GcRegionEntry *e = gc_region_find(key);
+  if (!e)
+    return;
+  size_t mask = gc_region_size - 1;
+  size_t hole = (size_t)(e - gc_regions);
+  size_t j = hole;
+  for (;;) {
+    j = (j + 1) & mask;
+    if (!gc_regions[j].key)
       break;
-    }
-    if (gc_hash_table[idx].ptr == NULL) {
-      return; // Not found
+    size_t home = gc_region_hash(gc_regions[j].key) & mask;
+    // Move j into the hole unless its home lies cyclically in (hole, j]
+    int stays = (hole <= j) ? (home > hole && home <= j)
+                            : (home > hole || home <= j);
+    if (!stays) {
+      gc_regions[hole] = gc_regions[j];
+      hole = j;
     }
   }
+  gc_regions[hole].key = 0;
+  gc_regions[hole].region = NULL;
+  gc_region_used--;
+}
 
-  if (found_idx == -1)
-    return;
+// --- Allocation -------------------------------------------------------------
 
-  // Clear the found slot
-  gc_hash_table[found_idx].ptr = NULL;
-  gc_hash_table[found_idx].slot = -1;
+static void gc_init(void) {
+  if (gc_initialized)
+    return;
+  int c = 0;
+  for (uint32_t units = 0; units <= GC_MAX_SMALL / 8; units++) {
+    while (gc_class_sizes[c] < units * 8)
+      c++;
+    gc_class_lookup[units] = (uint8_t)c;
+  }
+  gc_initialized = 1;
+}
 
-  // Re-hash the following cluster to fill the hole
-  int j = found_idx;
-  while (1) {
-    j = (j + 1) & (GC_HASH_SIZE - 1);
-    if (gc_hash_table[j].ptr == NULL)
-      break;
+// Start a new chunk for class c, linked in after `after` (the end of the
+// cursor's walk) so the full chunks already walked past stay behind it
+static GcChunk *gc_chunk_new(int c, GcChunk *after) {
+  void *mem = NULL;
+  if (posix_memalign(&mem, GC_CHUNK_SIZE, GC_CHUNK_SIZE) != 0)
+    return NULL;
+  GcChunk *chunk = mem;
+  chunk->free_cells = NULL;
+  chunk->cell_size = gc_class_sizes[c];
+  chunk->cell_count = 0;
+  chunk->cell_capacity = (GC_CHUNK_SIZE - GC_CHUNK_HEADER) / chunk->cell_size;
+  chunk->size_class = c;
+  if (!gc_region_insert((uintptr_t)chunk, chunk, 0)) {
+    free(chunk);
+    return NULL;
+  }
+  if (after) {
+    chunk->next = after->next;
+    after->next = chunk;
+  } else {
+    chunk->next = gc_chunks[c];
+    gc_chunks[c] = chunk;
+  }
+  return chunk;
+}
+
+// Take a cell of class c from the first chunk at or after the cursor that has
+// a free or uncarved one. The cursor only moves forward until a sweep resets
+// it, so each chunk is walked past at most once per cycle.
+static GcHeader *gc_cell_alloc(int c) {
+  GcChunk *chunk = gc_alloc_chunk[c], *last = NULL;
+  while (chunk && !chunk->free_cells &&
+         chunk->cell_count >= chunk->cell_capacity) {
+    last = chunk;
+    chunk = chunk->next;
+  }
+  if (!chunk && !(chunk = gc_chunk_new(c, last)))
+    return NULL;
+  gc_alloc_chunk[c] = chunk;
 
-    void *rehash_ptr = gc_hash_table[j].ptr;
-    int rehash_slot = gc_hash_table[j].slot;
-    gc_hash_table[j].ptr = NULL;
-    gc_hash_table[j].slot = -1;
-    gc_hash_insert(rehash_ptr, rehash_slot);
+  GcHeader *h = chunk->free_cells;
+  if (h) {
+    chunk->free_cells = *(GcHeader **)(h + 1);
+    return h;
   }
+  return (GcHeader *)((char *)chunk + GC_CHUNK_HEADER +
+                      (size_t)chunk->cell_count++ * chunk->cell_size);
 }
 
-// Find GC slot for a pointer using hash table (O(1) average)
-static int gc_find_slot(void *ptr) {
-  if (!ptr)
-    return -1;
-  gc_hash_init();
-  unsigned int h = gc_hash_ptr(ptr);
-  for (int i = 0; i < GC_HASH_SIZE; i++) {
-    unsigned int idx = (h + i) & (GC_HASH_SIZE - 1);
-    if (gc_hash_table[idx].ptr == ptr) {
-      // Verify the slot is still valid
-      int slot = gc_hash_table[idx].slot;
-      if (slot >= 0 && slot < GC_MAX_ALLOCATIONS &&
-          gc_allocations[slot].in_use && gc_allocations[slot].ptr == ptr) {
-        return slot;
-      }
-      return -1; // Stale entry
-    }
-    if (gc_hash_table[idx].ptr == NULL) {
-      return -1; // Not found
+// Allocate a GC-tracked block
+static void *gc_alloc(size_t size, GcAllocType type) {
+  gc_init();
+
+  size_t need = size + sizeof(GcHeader);
+  GcHeader *h;
+  if (need <= GC_MAX_SMALL) {
+    int c = gc_class_lookup[(need + 7) / 8];
+    if (!(h = gc_cell_alloc(c)))
+      return NULL;
+    h->size_class = (uint8_t)c;
+    gc_log_young(&gc_young_cells, (uintptr_t)h);
+    gc_account_alloc(gc_class_sizes[c]);
+    gc_type_bytes[type] += gc_class_sizes[c];
+  } else {
+    GcLarge *large = malloc(sizeof(GcLarge) + size);
+    if (!large)
+      return NULL;
+    h = &large->header;
+    if (!gc_region_insert((uintptr_t)(h + 1), large, 1)) {
+      free(large);
+      return NULL;
     }
+    large->prev = NULL;
+    large->next = gc_large_list;
+    if (gc_large_list)
+      gc_large_list->prev = large;
+    gc_large_list = large;
+    h->size_class = GC_LARGE_CLASS;
+    if (gc_phase == GC_IDLE)
+      gc_young_large++;
+    gc_account_alloc(sizeof(GcLarge) + size);
+    gc_type_bytes[type] += sizeof(GcLarge) + size;
   }
-  return -1;
+
+  h->size = (uint32_t)size;
+  h->type = (uint8_t)type;
+  h->marked = gc_alloc_mark;
+  gc_allocation_count++;
+  gc_stats.allocations++;
+  return h + 1;
 }
 
-// Mark a pointer as reachable
-static void gc_mark_ptr(void *ptr) {
-  int slot = gc_find_slot(ptr);
-  if (slot >= 0) {
-    gc_allocations[slot].marked = 1;
-  }
+// Payload bytes a request for size actually gets (the rest of its cell)
+static size_t gc_usable_size(size_t size) {
+  gc_init();
+  size_t need = size + sizeof(GcHeader);
+  if (need > GC_MAX_SMALL)
+    return size;
+  return gc_class_sizes[gc_class_lookup[(need + 7) / 8]] - sizeof(GcHeader);
 }
 
-// Forward declarations for mark phase (defined later)
-static void gc_mark(void);
-static void gc_sweep(void);
+// Header of a live heap block, or NULL if ptr isn't one (literal, freed, ...)
+static GcHeader *gc_header_of(void *ptr) {
+  uintptr_t p = (uintptr_t)ptr;
+  if (!p)
+    return NULL;
 
-// Run a full GC cycle
-static void gc_collect(void) {
-  gc_mark();
-  gc_sweep();
-}
+  GcRegionEntry *e = gc_region_find(p & ~(uintptr_t)(GC_CHUNK_SIZE - 1));
+  if (e && !e->is_large) {
+    GcChunk *chunk = e->region;
+    uintptr_t first = (uintptr_t)chunk + GC_CHUNK_HEADER + sizeof(GcHeader);
+    if (p < first)
+      return NULL;
+    uintptr_t off = p - first;
+    if (off % chunk->cell_size != 0 ||
+        off / chunk->cell_size >= chunk->cell_count)
+      return NULL;
+    GcHeader *h = (GcHeader *)ptr - 1;
+    return h->type == GC_TYPE_FREE ? NULL : h;
+  }
 
-// Check if GC should run
-static void gc_maybe_collect(void) {
-  if (gc_allocation_count >= gc_threshold) {
-    gc_collect();
+  e = gc_region_find(p);
+  if (e && e->is_large)
+    return &((GcLarge *)e->region)->header;
+  return NULL;
+}
+
+static void gc_release(GcHeader *h) {
+  if (h->size_class == GC_LARGE_CLASS) {
+    GcLarge *large = (GcLarge *)((char *)h - offsetof(GcLarge, header));
+    if (large == gc_sweep_large)
+      gc_sweep_large = large->next;
+    gc_region_remove((uintptr_t)(h + 1));
+    if (large->prev)
+      large->prev->next = large->next;
+    else
+      gc_large_list = large->next;
+    if (large->next)
+      large->next->prev = large->prev;
+    gc_account_free(sizeof(GcLarge) + h->size);
+    gc_type_bytes[h->type] -= sizeof(GcLarge) + h->size;
+    free(large);
+  } else {
+    GcChunk *chunk = (GcChunk *)((uintptr_t)h & ~(uintptr_t)(GC_CHUNK_SIZE - 1));
+    gc_account_free(chunk->cell_size);
+    gc_type_bytes[h->type] -= chunk->cell_size;
+    h->type = GC_TYPE_FREE;
+    *(GcHeader **)(h + 1) = chunk->free_cells;
+    chunk->free_cells = h;
   }
+  gc_allocation_count--;
 }
 
-// Public function to force a GC cycle (called when bot stops)
-void gc_force_collect(void) { gc_collect(); }
+// Free a block immediately (for buffers replaced before the next collection)
+static void gc_free(void *ptr) {
+  GcHeader *h = gc_header_of(ptr);
+  if (h)
+    gc_release(h);
+}
 
-// Unregister an allocation (for manual free)
-static void gc_unregister(void *ptr) {
-  int slot = gc_find_slot(ptr);
-  if (slot >= 0) {
-    gc_hash_remove(ptr); // Remove from hash table
-    gc_allocations[slot].in_use = 0;
-    gc_allocations[slot].ptr = NULL;
-    gc_allocation_count--;
+// Mark a pointer as reachable this cycle
+static void gc_mark_ptr(void *ptr) {
+  GcHeader *h = gc_header_of(ptr);
+  if (h)
+    h->marked = gc_epoch;
+}
+
+// Free the dead cells of one chunk and rebuild its free list; returns the
+// number of live cells
+static uint32_t gc_sweep_chunk(GcChunk *chunk) {
+  char *cells = (char *)chunk + GC_CHUNK_HEADER;
+  uint32_t live = 0;
+  chunk->free_cells = NULL;
+  // Push high-to-low so the list hands out low addresses first
+  for (uint32_t i = chunk->cell_count; i-- > 0;) {
+    GcHeader *h = (GcHeader *)(cells + (size_t)i * chunk->cell_size);
+    if (h->type != GC_TYPE_FREE) {
+      if (h->marked == gc_epoch) {
+        live++;
+        continue;
+      }
+      gc_type_bytes[h->type] -= chunk->cell_size;
+      h->type = GC_TYPE_FREE;
+      gc_allocation_count--;
+      gc_account_free(chunk->cell_size);
+    }
+    *(GcHeader **)(h + 1) = chunk->free_cells;
+    chunk->free_cells = h;
   }
+  return live;
+}
+
+static void gc_sweep_heap_begin(void) {
+  gc_sweep_class = 0;
+  gc_sweep_link = &gc_chunks[0];
+  gc_sweep_large = gc_large_list;
+}
+
+// Sweep the arena until *budget work units are used up, handing fully-empty
+// chunks back to the system. Returns 1 once the whole heap has been swept.
+// Blocks allocated since the cycle started carry its epoch, so they survive
+// whether or not the sweep has passed them yet.
+static int gc_sweep_heap_step(long *budget) {
+  while (gc_sweep_class < GC_NUM_CLASSES) {
+    int c = gc_sweep_class;
+    while (*gc_sweep_link) {
+      if (*budget <= 0)
+        return 0;
+      GcChunk *chunk = *gc_sweep_link;
+      *budget -= chunk->cell_count + 1;
+      // Keep the cursor's chunk even when empty: allocation is using it
+      if (gc_sweep_chunk(chunk) == 0 && chunk != gc_alloc_chunk[c]) {
+        *gc_sweep_link = chunk->next;
+        gc_region_remove((uintptr_t)chunk);
+        free(chunk);
+      } else {
+        gc_sweep_link = &chunk->next;
+      }
+    }
+    // Swept chunks may have room again: restart allocation from the front
+    gc_alloc_chunk[c] = gc_chunks[c];
+    if (++gc_sweep_class < GC_NUM_CLASSES)
+      gc_sweep_link = &gc_chunks[gc_sweep_class];
+  }
+
+  while (gc_sweep_large) {
+    if (*budget <= 0)
+      return 0;
+    GcLarge *large = gc_sweep_large;
+    gc_sweep_large = large->next;
+    (*budget)--;
+    if (large->header.marked != gc_epoch)
+      gc_release(&large->header);
+  }
+  return 1;
 }
 
 // ============================================================================
@@ -328,46 +732,437 @@ Value time_ms(void) {
   return VAL_INT((long)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000));
 }
 
+// ============================================================================
+// Handle Tables
+// Objects and lists live in growable tables indexed by handle. Index 0 is
+// reserved (a zero handle means "none") and indices must stay below the type
+// mask bits. Free slots are chained through a next_free field, so allocation
+// is a pop; gc_sweep rebuilds the chains in ascending index order.
+// ============================================================================
+
+#define HANDLE_TABLE_INITIAL 1024
+#define HANDLE_TABLE_MAX TYPE_MASK_OBJ // Exclusive: indices use bits 0-27
+
+// Grow a table (doubling) and zero the new tail. Returns the new base, or
+// NULL if it can't grow (the old table is left untouched).
+static void *handle_table_grow(void *table, int *size, size_t elem_size) {
+  int old_size = *size;
+  if (old_size >= HANDLE_TABLE_MAX)
+    return NULL;
+  int new_size = old_size ? old_size * 2 : HANDLE_TABLE_INITIAL;
+  if (new_size > HANDLE_TABLE_MAX)
+    new_size = HANDLE_TABLE_MAX;
+  char *grown = realloc(table, (size_t)new_size * elem_size);
+  if (!grown)
+    return NULL;
+  memset(grown + (size_t)old_size * elem_size, 0,
+         (size_t)(new_size - old_size) * elem_size);
+  *size = new_size;
+  return grown;
+}
+
+// ============================================================================
+// Atoms (Interned Property Keys and Strings)
+// Every distinct property key is stored once and referred to by a small
+// integer id. Objects and shapes hold ids, so key comparison is an integer
+// compare and adding a property never copies its key. Atoms are immortal.
+// An atom's name is the canonical interned string for its chars, which is
+// what ds_intern hands out.
+// ============================================================================
+
+static char **atom_names = NULL; // id -> canonical key (id 0 is "no atom")
+static int atom_count = 1;
+static int atom_capacity = 0;
+static int *atom_table = NULL; // Open-addressed hash of ids, 0 = empty
+static int atom_table_size = 0; // Power of 2
+
+// FNV-1a, cut to the 31 bits a StrHeader caches
+static uint32_t str_hash_chars(const char *s, size_t length) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 16777619u;
+  }
+  h &= STR_HASH_MASK;
+  return h ? h : 1;
+}
+
+static int atom_table_grow(void) {
+  int new_size = atom_table_size ? atom_table_size * 2 : 1024;
+  int *new_table = calloc(new_size, sizeof(int));
+  if (!new_table)
+    return 0;
+  for (int id = 1; id < atom_count; id++) {
+    unsigned int h =
+        (STR_HEADER(atom_names[id])->hash & STR_HASH_MASK) & (new_size - 1);
+    while (new_table[h])
+      h = (h + 1) & (new_size - 1);
+    new_table[h] = id;
+  }
+  free(atom_table);
+  atom_table = new_table;
+  atom_table_size = new_size;
+  return 1;
+}
+
+// Find the table slot for a key: either the slot holding its id or the empty
+// slot where it would go. Names are compared by cached hash and length first.
+static unsigned int atom_probe(const char *key, size_t length, uint32_t hash) {
+  unsigned int mask = atom_table_size - 1;
+  unsigned int h = hash & mask;
+  while (atom_table[h]) {
+    const char *name = atom_names[atom_table[h]];
+    StrHeader *nh = STR_HEADER(name);
+    if ((nh->hash & STR_HASH_MASK) == hash && nh->length == length &&
+        memcmp(name, key, length) == 0)
+      break;
+    h = (h + 1) & mask;
+  }
+  return h;
+}
+
+// Look up an existing atom without creating one (0 if never interned)
+static int atom_lookup(Value key) {
+  if (!key || IS_INT(key) || IS_ARRAY(key) || atom_table_size == 0)
+    return 0;
+  return atom_table[atom_probe((const char *)AS_OBJ(key), str_length(key),
+                               str_hash(key))];
+}
+
+// Find or add the atom for `length` chars at `key`. A new atom's name is
+// `adopt` when given (static storage with a header, handed over by the
+// caller), else an immortal copy.
+static int atom_intern(const char *key, size_t length, uint32_t hash,
+                       char *adopt) {
+  if (atom_count * 2 >= atom_table_size && !atom_table_grow())
+    return 0;
+
+  unsigned int h = atom_probe(key, length, hash);
+  if (atom_table[h])
+    return atom_table[h];
+
+  if (atom_count >= atom_capacity) {
+    int new_capacity = atom_capacity ? atom_capacity * 2 : 512;
+    char **new_names = realloc(atom_names, new_capacity * sizeof(char *));
+    if (!new_names)
+      return 0;
+    atom_names = new_names;
+    atom_capacity = new_capacity;
+  }
+  char *name = adopt;
+  if (!name) {
+    StrHeader *header = malloc(sizeof(StrHeader) + length + 1);
+    if (!header)
+      return 0;
+    header->length = (uint32_t)length;
+    name = (char *)(header + 1);
+    memcpy(name, key, length);
+    name[length] = '\0';
+  }
+  STR_HEADER(name)->hash = hash | STR_INTERNED;
+
+  int id = atom_count++;
+  atom_names[id] = name;
+  atom_table[h] = id;
+  return id;
+}
+
+int ds_atom_intern(const char *key) {
+  if (!key)
+    return 0;
+  size_t length = strlen(key);
+  return atom_intern(key, length, str_hash_chars(key, length), NULL);
+}
+
+const char *ds_atom_name(int atom) {
+  if (atom <= 0 || atom >= atom_count)
+    return (const char *)AS_OBJ(STR_LIT(""));
+  return atom_names[atom];
+}
+
 // ============================================================================
 // Object System Implementation
 // ============================================================================
 
-#define MAX_OBJECTS 65536
 #define MAX_PROPS 256
 
+// Most objects have a handful of fields, so each slot stores a few inline and
+// spills to an out-of-line vector (from the property slabs below) past that.
+#define OBJECT_INLINE_PROPS 6
+
 typedef struct {
-  char *key;
+  int key; // Atom id
   Value value;
 } Property;
 
 typedef struct {
-  Property props[MAX_PROPS];
+  Property inline_props[OBJECT_INLINE_PROPS];
+  Property *spill; // Out-of-line props once prop_count > OBJECT_INLINE_PROPS
   int prop_count;
+  int prop_capacity;
+  int shape; // Hidden class (see Shapes below); SHAPE_DICT if uncacheable
+  struct MapTable *map; // Hash table if the slot is a map (see Maps), or NULL
   int in_use;
-  int marked; // For GC
+  int marked;      // For GC
+  int remembered;  // Old and logged in gc_remembered since the last minor
+  int encoding;    // On the encoder's current path (cycle check)
+  int next_free;   // Free-list link while !in_use
 } Object;
 
-static Object objects[MAX_OBJECTS];
-static int objects_initialized = 0;
+static Object *objects = NULL;
+static int object_table_size = 0;
+static int object_free_head = 0; // 0 = free list empty
 
-static void init_objects(void) {
-  if (objects_initialized)
-    return;
-  memset(objects, 0, sizeof(objects));
-  objects_initialized = 1;
+// All props live contiguously in whichever storage is current
+static inline Property *object_props(Object *o) {
+  return o->spill ? o->spill : o->inline_props;
+}
+
+// ============================================================================
+// Property Slabs
+// Spilled property vectors come in power-of-two size classes (16..256 props)
+// carved from 64 KB slabs. Freed vectors go on a per-class free list and are
+// reused; slab memory itself is kept for the life of the program.
+// ============================================================================
+
+#define PROP_SLAB_BYTES 65536
+#define PROP_MIN_SPILL 16
+#define PROP_CLASSES 5 // 16, 32, 64, 128, 256
+
+static Property *prop_free_lists[PROP_CLASSES]; // Next link in first bytes
+static char *prop_slab_cur = NULL;
+static char *prop_slab_end = NULL;
+
+static int prop_class(int capacity) {
+  int c = 0;
+  while ((PROP_MIN_SPILL << c) < capacity)
+    c++;
+  return c;
+}
+
+static Property *prop_vec_alloc(int capacity) {
+  int c = prop_class(capacity);
+  Property *vec = prop_free_lists[c];
+  if (vec) {
+    prop_free_lists[c] = *(Property **)vec;
+    return vec;
+  }
+
+  size_t bytes = (size_t)(PROP_MIN_SPILL << c) * sizeof(Property);
+  if (prop_slab_cur == NULL || prop_slab_cur + bytes > prop_slab_end) {
+    // Whatever is left of the old slab is abandoned; it's < 4 KB
+    prop_slab_cur = malloc(PROP_SLAB_BYTES);
+    if (!prop_slab_cur) {
+      prop_slab_end = NULL;
+      return NULL;
+    }
+    prop_slab_end = prop_slab_cur + PROP_SLAB_BYTES;
+  }
+  vec = (Property *)prop_slab_cur;
+  prop_slab_cur += bytes;
+  return vec;
+}
+
+static void prop_vec_free(Property *vec, int capacity) {
+  int c = prop_class(capacity);
+  *(Property **)vec = prop_free_lists[c];
+  prop_free_lists[c] = vec;
+}
+
+// Make room for one more property; 0 if the object is full or OOM
+static int object_reserve_prop(Object *o) {
+  if (o->prop_count < o->prop_capacity)
+    return 1;
+  if (o->prop_capacity >= MAX_PROPS)
+    return 0;
+
+  int new_capacity = o->spill ? o->prop_capacity * 2 : PROP_MIN_SPILL;
+  Property *vec = prop_vec_alloc(new_capacity);
+  if (!vec)
+    return 0;
+  memcpy(vec, object_props(o), o->prop_count * sizeof(Property));
+  if (o->spill)
+    prop_vec_free(o->spill, o->prop_capacity);
+  o->spill = vec;
+  o->prop_capacity = new_capacity;
+  return 1;
+}
+
+// Give back an object's spilled storage (called when the slot is reclaimed)
+static void object_release_props(Object *o) {
+  if (o->spill) {
+    prop_vec_free(o->spill, o->prop_capacity);
+    o->spill = NULL;
+  }
+  o->prop_capacity = OBJECT_INLINE_PROPS;
+}
+
+// ============================================================================
+// Shapes (Hidden Classes)
+// Objects that gain the same keys in the same order share a shape. A shape is
+// a node in a transition tree rooted at the empty shape: each node records the
+// key it added and the slot that key lives at. Property caches key off the
+// shape id, so a matching shape means the slot is known without a key search.
+// Shapes are never freed.
+// ============================================================================
+
+#define MAX_SHAPES 16384
+#define SHAPE_MAX_PROPS 64 // Objects with more keys than this go dictionary
+#define SHAPE_DICT -1      // Dictionary mode: no shape, never cached
+#define SHAPE_ROOT 1       // Empty object (0 is left unused: an empty cache)
+
+typedef struct {
+  int key;          // Atom added by the transition into this shape
+  int parent;       // Shape before the key was added
+  int slot;         // Slot of `key` (== number of props - 1)
+  int first_child;  // Head of outgoing transitions
+  int next_sibling; // Next transition out of `parent`
+} Shape;
+
+static Shape shapes[MAX_SHAPES];
+static int shape_count = SHAPE_ROOT + 1;
+
+// Find or create the shape reached from `from` by adding `key`.
+// Returns SHAPE_DICT when the tree is full or the object has grown too wide.
+static int shape_transition(int from, int key) {
+  if (from == SHAPE_DICT)
+    return SHAPE_DICT;
+  int slot = (from == SHAPE_ROOT) ? 0 : shapes[from].slot + 1;
+  if (slot >= SHAPE_MAX_PROPS)
+    return SHAPE_DICT;
+
+  for (int s = shapes[from].first_child; s; s = shapes[s].next_sibling) {
+    if (shapes[s].key == key)
+      return s;
+  }
+
+  if (shape_count >= MAX_SHAPES)
+    return SHAPE_DICT;
+
+  int s = shape_count++;
+  shapes[s].key = key;
+  shapes[s].parent = from;
+  shapes[s].slot = slot;
+  shapes[s].first_child = 0;
+  shapes[s].next_sibling = shapes[from].first_child;
+  shapes[from].first_child = s;
+  return s;
+}
+
+static int grow_objects(void) {
+  int old_size = object_table_size;
+  Object *grown = handle_table_grow(objects, &object_table_size, sizeof(Object));
+  if (!grown)
+    return 0;
+  objects = grown;
+  // Chain the new slots (skipping reserved index 0) onto the free list
+  for (int i = object_table_size - 1; i >= old_size && i > 0; i--) {
+    objects[i].next_free = object_free_head;
+    object_free_head = i;
+  }
+  return 1;
 }
 
 static int alloc_object_idx(void) {
-  init_objects();
-  for (int i = 1; i < MAX_OBJECTS; i++) {
-    if (!objects[i].in_use) {
-      objects[i].in_use = 1;
-      objects[i].marked = 0;
-      objects[i].prop_count = 0;
+  if (object_free_head == 0 && !grow_objects()) {
+    gc_alloc_failed("object table");
+    return 0;
+  }
+  int i = object_free_head;
+  object_free_head = objects[i].next_free;
+  objects[i].in_use = 1;
+  objects[i].marked = gc_alloc_mark;
+  objects[i].remembered = 0;
+  objects[i].prop_count = 0;
+  objects[i].prop_capacity = OBJECT_INLINE_PROPS;
+  objects[i].spill = NULL;
+  objects[i].shape = SHAPE_ROOT;
+  objects[i].map = NULL;
+  gc_log_young(&gc_young_objects, i);
+  gc_account_alloc(sizeof(Object));
+  gc_stats.objects++;
+  gc_stats.allocations++;
+  return i;
+}
+
+// Resolve an object handle to its table index, or 0 if it isn't a live object
+static inline long object_index(Value obj_val) {
+  long handle = AS_INT(obj_val);
+  if ((handle & TYPE_MASK_OBJ) != TYPE_MASK_OBJ)
+    return 0;
+  long obj = handle & ~TYPE_MASK_OBJ;
+  if (obj <= 0 || obj >= object_table_size || !objects[obj].in_use)
+    return 0;
+  return obj;
+}
+
+// Find the slot holding `key`, or -1
+static int object_find_slot(Object *o, int key) {
+  Property *props = object_props(o);
+  for (int i = 0; i < o->prop_count; i++) {
+    if (props[i].key == key) {
       return i;
     }
   }
-  return 0;
+  return -1;
+}
+
+// Append a new property, moving the object along its shape transition
+static int object_add_prop(Object *o, int key, Value value) {
+  if (key == 0 || !object_reserve_prop(o))
+    return -1;
+  int idx = o->prop_count++;
+  o->shape = shape_transition(o->shape, key);
+  object_props(o)[idx].key = key;
+  object_props(o)[idx].value = value;
+  return idx;
+}
+
+// Write barrier for a store into objects[idx]: the incremental half shades
+// the value, the generational half remembers an old object given a reference
+static inline void object_barrier(long idx, Value value) {
+  gc_write_barrier(value);
+  Object *o = &objects[idx];
+  if (o->marked == gc_epoch && !o->remembered && gc_phase == GC_IDLE &&
+      GC_IS_REF(value)) {
+    o->remembered = 1;
+    if (!gc_log_push(&gc_remembered, VAL_INT(idx | TYPE_MASK_OBJ)))
+      gc_nursery_lost = 1;
+  }
+}
+
+// Resolve (allocating if null/zero) the target of a store; 0 on failure or
+// for a map, which holds entries rather than props
+static long object_store_target(Value *obj) {
+  long handle = AS_INT(*obj);
+
+  // Auto-allocate if null/zero
+  if (handle == 0) {
+    int idx = alloc_object_idx();
+    if (idx == 0)
+      return 0;
+    *obj = VAL_INT(idx | TYPE_MASK_OBJ);
+    gc_note_root_store(obj);
+    return idx;
+  }
+  long idx = object_index(*obj);
+  return idx && !objects[idx].map ? idx : 0;
+}
+
+// 1 if the value was stored
+static int object_store(Value *obj, int key, Value value) {
+  long handle = object_store_target(obj);
+  if (handle == 0)
+    return 0;
+  object_barrier(handle, value);
+
+  Object *o = &objects[handle];
+  int slot = object_find_slot(o, key);
+  if (slot >= 0) {
+    object_props(o)[slot].value = value;
+    return 1;
+  }
+  return object_add_prop(o, key, value) >= 0;
 }
 
 Value ds_object_create(Value count_val, ...) {
@@ -384,131 +1179,302 @@ Value ds_object_create(Value count_val, ...) {
   for (int i = 0; i < count; i++) {
     const char *key = va_arg(args, const char *);
     Value val = va_arg(args, Value);
-    ds_object_set(&handle, VAL_OBJ(key), val);
+    object_store(&handle, ds_atom_intern(key), val);
   }
 
   va_end(args);
   return handle;
 }
 
-Value ds_object_get(Value obj_val, Value key_val) {
-  const char *key = (const char *)AS_OBJ(key_val);
-  long handle = AS_INT(obj_val);
-
-  // Validate Object Mask
-  if ((handle & TYPE_MASK_OBJ) != TYPE_MASK_OBJ)
+Value ds_object_create_atoms(Value count_val, ...) {
+  int count = (int)AS_INT(count_val);
+  int idx = alloc_object_idx();
+  if (idx == 0)
     return VAL_INT(0);
-  long obj = handle & ~TYPE_MASK_OBJ;
 
-  if (obj <= 0 || obj >= MAX_OBJECTS)
+  Value handle = VAL_INT(idx | TYPE_MASK_OBJ);
+
+  va_list args;
+  va_start(args, count_val);
+
+  for (int i = 0; i < count; i++) {
+    int key = va_arg(args, int);
+    Value val = va_arg(args, Value);
+    object_store(&handle, key, val);
+  }
+
+  va_end(args);
+  return handle;
+}
+
+Value ds_object_get(Value obj_val, Value key_val) {
+  long obj = object_index(obj_val);
+  if (obj == 0)
     return VAL_INT(0);
-  if (!objects[obj].in_use)
+  // A key that was never interned can't be on any object
+  int key = atom_lookup(key_val);
+  if (key == 0)
     return VAL_INT(0);
-
-  for (int i = 0; i < objects[obj].prop_count; i++) {
-    if (strcmp(objects[obj].props[i].key, key) == 0) {
-      return objects[obj].props[i].value;
+  int slot = object_find_slot(&objects[obj], key);
+  return slot >= 0 ? object_props(&objects[obj])[slot].value : VAL_INT(0);
+}
+
+static long object_keys_refused = 0;
+
+// Atoms are never freed, so a key built at run time is only stored if it is
+// an atom already (the lexers intern the names they read); interning every
+// such key would leak. A literal (not a heap block) is bounded by the program
+// text, so it is interned on first use. A refused key is a lost write, so the
+// first one is reported; keys from data belong in a map.
+Value ds_object_set(Value *obj, Value key_val, Value value) {
+  int key = atom_lookup(key_val);
+  if (key == 0 && key_val && !IS_INT(key_val) && !IS_ARRAY(key_val)) {
+    if (gc_header_of(STR_HEADER(key_val))) {
+      if (object_keys_refused++ == 0)
+        printf("[OBJECT ERROR] key \"%s\" was never interned; not stored "
+               "(intern it with ds_intern, or use a map)\n",
+               (const char *)AS_OBJ(key_val));
+      return VAL_INT(0);
     }
+    key = atom_intern((const char *)AS_OBJ(key_val), str_length(key_val),
+                      str_hash(key_val), NULL);
   }
-  return VAL_INT(0);
+  if (key == 0)
+    return VAL_INT(0);
+  return VAL_INT(object_store(obj, key, value));
 }
 
-void ds_object_set(Value *obj, Value key_val, Value value) {
-  const char *key = (const char *)AS_OBJ(key_val);
-  Value handle_val = *obj;
-  long handle = AS_INT(handle_val);
+Value ds_object_get_ic(Value obj_val, int key, PropCache *ic) {
+  long obj = object_index(obj_val);
+  if (obj == 0)
+    return VAL_INT(0);
+  Object *o = &objects[obj];
+  if (o->shape == ic->shape)
+    return object_props(o)[ic->slot].value;
 
-  // Auto-allocate if null/zero
-  if (handle == 0) {
-    int idx = alloc_object_idx();
-    if (idx == 0)
-      return;
-    handle = idx | TYPE_MASK_OBJ;
-    *obj = VAL_INT(handle);
-  } else {
-    // Validate existing handle
-    if ((handle & TYPE_MASK_OBJ) != TYPE_MASK_OBJ)
-      return; // Not an object, ignore
-    handle = handle & ~TYPE_MASK_OBJ;
+  int slot = object_find_slot(o, key);
+  if (slot < 0)
+    return VAL_INT(0);
+  if (o->shape != SHAPE_DICT) {
+    ic->shape = o->shape;
+    ic->slot = slot;
+    ic->transition = 0;
   }
+  return object_props(o)[slot].value;
+}
 
-  if (handle <= 0 || handle >= MAX_OBJECTS)
-    return;
-
-  if (!objects[handle].in_use) {
+void ds_object_set_ic(Value *obj, int key, Value value, PropCache *ic) {
+  long handle = object_store_target(obj);
+  if (handle == 0)
     return;
-  }
+  object_barrier(handle, value);
 
-  // Update existing
-  for (int i = 0; i < objects[handle].prop_count; i++) {
-    if (strcmp(objects[handle].props[i].key, key) == 0) {
-      objects[handle].props[i].value = value;
+  Object *o = &objects[handle];
+  if (o->shape == ic->shape) {
+    if (!ic->transition) {
+      object_props(o)[ic->slot].value = value;
+      return;
+    }
+    // Cached add: same starting shape always takes the same transition
+    if (object_reserve_prop(o)) {
+      object_props(o)[ic->slot].key = key;
+      object_props(o)[ic->slot].value = value;
+      o->prop_count++;
+      o->shape = ic->transition;
       return;
     }
   }
 
-  // Add new
-  if (objects[handle].prop_count < MAX_PROPS) {
-    int idx = objects[handle].prop_count++;
-    // Use gc_alloc instead of strdup for GC tracking
-    size_t key_len = strlen(key) + 1;
-    char *key_copy = gc_alloc(key_len, GC_TYPE_STRING);
-    if (key_copy) {
-      memcpy(key_copy, key, key_len);
-      objects[handle].props[idx].key = key_copy;
-    } else {
-      objects[handle].props[idx].key = NULL;
+  int from = o->shape;
+  int slot = object_find_slot(o, key);
+  if (slot >= 0) {
+    object_props(o)[slot].value = value;
+    if (from != SHAPE_DICT) {
+      ic->shape = from;
+      ic->slot = slot;
+      ic->transition = 0;
     }
-    objects[handle].props[idx].value = value;
+    return;
+  }
+
+  slot = object_add_prop(o, key, value);
+  if (slot >= 0 && from != SHAPE_DICT && o->shape != SHAPE_DICT) {
+    ic->shape = from;
+    ic->slot = slot;
+    ic->transition = o->shape;
   }
 }
 
-void ds_set_prop(Value obj_val, Value key_val, Value value) {
+Value ds_set_prop(Value obj_val, Value key_val, Value value) {
   long handle = AS_INT(obj_val);
   // Validate mask before passing address (though ds_object_set checks too)
   if ((handle & TYPE_MASK_OBJ) != TYPE_MASK_OBJ)
-    return;
+    return VAL_INT(0);
 
   // We need to pass a pointer, but obj_val itself is the handle
-  ds_object_set(&obj_val, key_val, value);
+  return ds_object_set(&obj_val, key_val, value);
 }
 
-Value ds_strlen(Value str_val) {
-  // Use AS_OBJ to get pointer value (clears lowest bit if any)
-  const char *str = (const char *)AS_OBJ(str_val);
-  if (!str)
-    return VAL_INT(0);
-  return VAL_INT((long)strlen(str));
-}
-Value ds_streq(Value s1_val, Value s2_val) {
-  const char *s1 = (const char *)AS_OBJ(s1_val);
-  const char *s2 = (const char *)AS_OBJ(s2_val);
-  if (!s1 || !s2)
-    return VAL_INT(0);
-  return VAL_INT(strcmp(s1, s2) == 0);
-}
+// ============================================================================
+// Strings
+// A string is its chars preceded by a StrHeader (see runtime.h). On the heap
+// the header starts the GC block, so the block is found from STR_HEADER.
+// ============================================================================
 
-Value val_eq(Value a, Value b) {
-  if (a == b)
-    return VAL_INT(1);
-  if (IS_INT(a) || IS_INT(b))
-    return VAL_INT(0);
-  const char *s1 = (const char *)AS_OBJ(a);
-  const char *s2 = (const char *)AS_OBJ(b);
-  if (!s1 || !s2)
-    return VAL_INT(0);
-  return VAL_INT(strcmp(s1, s2) == 0);
+// Allocate a string of `length` chars for the caller to fill; NULL if OOM
+static char *str_alloc(size_t length) {
+  StrHeader *h = gc_alloc(sizeof(StrHeader) + length + 1, GC_TYPE_STRING);
+  if (!h)
+    return NULL;
+  h->length = (uint32_t)length;
+  h->hash = 0;
+  char *chars = (char *)(h + 1);
+  chars[length] = '\0';
+  return chars;
+}
+
+// Immortal strings: every single-char string, and the decimal form of every
+// int in [STR_SMALL_INT_MIN, STR_SMALL_INT_MAX], live in static storage built
+// on first use. The GC never sees them, so the calls that hand them out
+// (char_to_string, int_to_string, one-char substrings) allocate nothing.
+#ifndef STR_SMALL_INT_MIN
+#define STR_SMALL_INT_MIN (-128)
+#endif
+#ifndef STR_SMALL_INT_MAX
+#define STR_SMALL_INT_MAX 1023
+#endif
+
+typedef struct {
+  StrHeader header;
+  char chars[2];
+} __attribute__((aligned(8))) StrChar;
+
+typedef struct {
+  StrHeader header;
+  char chars[16]; // Room for any 32-bit int; the range needs no more
+} __attribute__((aligned(8))) StrSmallInt;
+
+static StrChar str_chars[256];
+static StrSmallInt str_small_ints[STR_SMALL_INT_MAX - STR_SMALL_INT_MIN + 1];
+static int str_immortal_ready = 0;
+
+static void str_immortal_init(void) {
+  for (int c = 0; c < 256; c++) {
+    str_chars[c].header.length = 1;
+    str_chars[c].chars[0] = (char)c;
+  }
+  for (long n = STR_SMALL_INT_MIN; n <= STR_SMALL_INT_MAX; n++) {
+    StrSmallInt *s = &str_small_ints[n - STR_SMALL_INT_MIN];
+    s->header.length = snprintf(s->chars, sizeof(s->chars), "%ld", n);
+  }
+  str_immortal_ready = 1;
 }
 
-Value ds_div(Value a, Value b) {
-  long ia = AS_INT(a);
-  long ib = AS_INT(b);
-  if (ib == 0)
-    return VAL_INT(0);
-  return VAL_INT(ia / ib);
+static inline Value str_char(unsigned char c) {
+  if (!str_immortal_ready)
+    str_immortal_init();
+  return VAL_OBJ(str_chars[c].chars);
 }
 
-Value ds_mod(Value a, Value b) {
+// A heap copy of `length` chars, or "" if OOM
+static Value str_from(const char *chars, size_t length) {
+  if (length <= 1)
+    return length ? str_char((unsigned char)chars[0]) : STR_LIT("");
+  char *result = str_alloc(length);
+  if (!result)
+    return STR_LIT("");
+  memcpy(result, chars, length);
+  return VAL_OBJ(result);
+}
+
+Value str_from_c(const char *chars) {
+  return chars ? str_from(chars, strlen(chars)) : STR_LIT("");
+}
+
+// Buffers the runtime refills in place (clipboard, save data). Their values
+// alias the buffer, as they always have; the header is set on each refill.
+#define STR_BUFFER(name, capacity)                                             \
+  static struct {                                                              \
+    StrHeader header;                                                          \
+    char chars[capacity];                                                      \
+  } __attribute__((aligned(8))) name
+
+static Value str_buffer_value(StrHeader *h) {
+  h->length = (uint32_t)strlen((char *)(h + 1));
+  h->hash = 0;
+  return VAL_OBJ(h + 1);
+}
+
+// 0 for a typed array, whose count sits where the hash would
+uint32_t str_hash(Value s) {
+  if (!s || IS_INT(s) || IS_ARRAY(s))
+    return 0;
+  StrHeader *h = STR_HEADER(s);
+  if (h->hash == 0)
+    h->hash = str_hash_chars((const char *)AS_OBJ(s), h->length);
+  return h->hash & STR_HASH_MASK;
+}
+
+Value ds_intern(Value str) {
+  if (!str || IS_INT(str) || IS_ARRAY(str) ||
+      (STR_HEADER(str)->hash & STR_INTERNED))
+    return str;
+  int id = atom_intern((const char *)AS_OBJ(str), str_length(str),
+                       str_hash(str), NULL);
+  return id ? VAL_OBJ(atom_names[id]) : str;
+}
+
+Value ds_intern_literal(Value lit) {
+  if (!lit || IS_INT(lit) || IS_ARRAY(lit) ||
+      (STR_HEADER(lit)->hash & STR_INTERNED))
+    return lit;
+  int id = atom_intern((const char *)AS_OBJ(lit), str_length(lit),
+                       str_hash(lit), (char *)AS_OBJ(lit));
+  return id ? VAL_OBJ(atom_names[id]) : lit;
+}
+
+// Compare two distinct string values: interned pairs never match, then
+// lengths and any cached hashes are checked before the chars. Typed arrays
+// compare by identity: their tag never equals a string length, and two
+// distinct arrays of one kind stop at the tag check.
+static int str_equal(Value a, Value b) {
+  StrHeader *ha = STR_HEADER(a), *hb = STR_HEADER(b);
+  if (ha->hash & hb->hash & STR_INTERNED)
+    return 0;
+  if (ha->length != hb->length || ha->length >= ARRAY_TAG)
+    return 0;
+  if (ha->hash && hb->hash && ((ha->hash ^ hb->hash) & STR_HASH_MASK))
+    return 0;
+  return memcmp((char *)AS_OBJ(a), (char *)AS_OBJ(b), ha->length) == 0;
+}
+
+Value ds_strlen(Value str_val) { return VAL_INT(str_length(str_val)); }
+
+Value ds_streq(Value s1_val, Value s2_val) {
+  if (!s1_val || !s2_val || IS_INT(s1_val) || IS_INT(s2_val))
+    return VAL_INT(0);
+  return VAL_INT(s1_val == s2_val || str_equal(s1_val, s2_val));
+}
+
+Value val_eq(Value a, Value b) {
+  if (a == b)
+    return VAL_INT(1);
+  if (IS_INT(a) || IS_INT(b))
+    return VAL_INT(0);
+  if (!a || !b)
+    return VAL_INT(0);
+  return VAL_INT(str_equal(a, b));
+}
+
+Value ds_div(Value a, Value b) {
+  long ia = AS_INT(a);
+  long ib = AS_INT(b);
+  if (ib == 0)
+    return VAL_INT(0);
+  return VAL_INT(ia / ib);
+}
+
+Value ds_mod(Value a, Value b) {
   long ia = AS_INT(a);
   long ib = AS_INT(b);
   if (ib == 0)
@@ -527,166 +1493,208 @@ Value ds_is_string_like(Value val) {
 // Robust check: is this value a string?
 Value ds_is_string(Value val) {
   // With tagging: integers are odd (bit 0 = 1), pointers are even (bit 0 = 0)
-  return VAL_INT(IS_OBJ(val));
+  return VAL_INT(IS_OBJ(val) && !IS_ARRAY(val));
 }
 Value ds_substring(Value str_val, Value start_val, Value len_val) {
-  const char *str = (const char *)AS_OBJ(str_val);
   long start = AS_INT(start_val);
   long len = AS_INT(len_val);
-  if (!str || len <= 0)
-    return VAL_OBJ("");
-  size_t str_len = strlen(str);
-  if (start >= (long)str_len)
-    return VAL_OBJ("");
-  if (start + len > (long)str_len)
+  long str_len = str_length(str_val);
+  if (len <= 0 || start < 0 || start >= str_len)
+    return STR_LIT("");
+  if (start + len > str_len)
     len = str_len - start;
-  char *sub = gc_alloc(len + 1, GC_TYPE_STRING);
-  if (!sub)
-    return VAL_OBJ("");
-  strncpy(sub, str + start, len);
-  sub[len] = '\0';
-  return VAL_OBJ(sub);
+  return str_from((const char *)AS_OBJ(str_val) + start, len);
 }
 
 Value ds_string_at(Value str_val, Value index_val) {
-  const char *str = (const char *)AS_OBJ(str_val);
   long index = AS_INT(index_val);
-  if (!str)
-    return VAL_INT(0);
-  if (index < 0 || index >= (long)strlen(str))
+  if (index < 0 || index >= str_length(str_val))
     return VAL_INT(0);
-  return VAL_INT((long)str[index]);
+  return VAL_INT((long)((const char *)AS_OBJ(str_val))[index]);
 }
 
 // Insert a character at position in string, returns new string
 Value ds_string_insert_char(Value str_val, Value pos_val, Value char_code_val) {
-  const char *str = (const char *)AS_OBJ(str_val);
+  const char *str = str_val ? (const char *)AS_OBJ(str_val) : "";
   long pos = AS_INT(pos_val);
   long char_code = AS_INT(char_code_val);
-  if (!str)
-    str = "";
-  size_t len = strlen(str);
+  long len = str_length(str_val);
   if (pos < 0)
     pos = 0;
-  if (pos > (long)len)
+  if (pos > len)
     pos = len;
 
-  char *result = gc_alloc(len + 2, GC_TYPE_STRING);
+  char *result = str_alloc(len + 1);
   if (!result)
     return str_val;
-  strncpy(result, str, pos);
+  memcpy(result, str, pos);
   result[pos] = (char)char_code;
-  strcpy(result + pos + 1, str + pos);
+  memcpy(result + pos + 1, str + pos, len - pos);
   return VAL_OBJ(result);
 }
 
 // Delete character at position in string, returns new string
 Value ds_string_delete_char(Value str_val, Value pos_val) {
-  const char *str = (const char *)AS_OBJ(str_val);
   long pos = AS_INT(pos_val);
-  if (!str)
-    return VAL_OBJ("");
-  size_t len = strlen(str);
-  if (pos < 0 || pos >= (long)len)
+  if (!str_val)
+    return STR_LIT("");
+  long len = str_length(str_val);
+  if (pos < 0 || pos >= len)
     return str_val;
 
-  char *result = gc_alloc(len, GC_TYPE_STRING);
+  const char *str = (const char *)AS_OBJ(str_val);
+  char *result = str_alloc(len - 1);
   if (!result)
     return str_val;
-  strncpy(result, str, pos);
-  strcpy(result + pos, str + pos + 1);
+  memcpy(result, str, pos);
+  memcpy(result + pos, str + pos + 1, len - pos - 1);
   return VAL_OBJ(result);
 }
 
 // Get string length
 Value ds_string_length(Value str_val) {
-  const char *str = (const char *)AS_OBJ(str_val);
-  if (!str)
-    return VAL_INT(0);
-  return VAL_INT(strlen(str));
+  return VAL_INT(str_length(str_val));
 }
 
 // Convert integer to string
 Value ds_int_to_string(Value int_val) {
+  long n = AS_INT(int_val);
+  if (n >= STR_SMALL_INT_MIN && n <= STR_SMALL_INT_MAX) {
+    if (!str_immortal_ready)
+      str_immortal_init();
+    return VAL_OBJ(str_small_ints[n - STR_SMALL_INT_MIN].chars);
+  }
   char buf[32];
-  snprintf(buf, sizeof(buf), "%ld", AS_INT(int_val));
-
-  size_t len = strlen(buf);
-  char *result = gc_alloc(len + 1, GC_TYPE_STRING);
-  if (!result)
-    return VAL_OBJ("");
-  strcpy(result, buf);
-  return VAL_OBJ(result);
+  int len = snprintf(buf, sizeof(buf), "%ld", n);
+  return str_from(buf, len);
 }
 
 // Concatenate two strings
 Value ds_string_concat(Value str1_val, Value str2_val) {
-  const char *str1 = (const char *)AS_OBJ(str1_val);
-  const char *str2 = (const char *)AS_OBJ(str2_val);
-  if (!str1)
-    str1 = "";
-  if (!str2)
-    str2 = "";
-
-  size_t len1 = strlen(str1);
-  size_t len2 = strlen(str2);
-  char *result = gc_alloc(len1 + len2 + 1, GC_TYPE_STRING);
+  long len1 = str_length(str1_val);
+  long len2 = str_length(str2_val);
+  char *result = str_alloc(len1 + len2);
   if (!result)
     return str1_val;
-  strcpy(result, str1);
-  strcpy(result + len1, str2);
+  if (len1)
+    memcpy(result, AS_OBJ(str1_val), len1);
+  if (len2)
+    memcpy(result + len1, AS_OBJ(str2_val), len2);
   return VAL_OBJ(result);
 }
 
 // Create a single-character string from char code
 Value ds_char_to_string(Value char_code_val) {
-  long char_code = AS_INT(char_code_val);
-  char *result = gc_alloc(2, GC_TYPE_STRING);
-  if (!result)
-    return VAL_OBJ("");
-  result[0] = (char)char_code;
-  result[1] = '\0';
-  return VAL_OBJ(result);
+  unsigned char c = (unsigned char)AS_INT(char_code_val);
+  return c ? str_char(c) : STR_LIT("");
 }
 
 // ============================================================================
 // List System Implementation
 // ============================================================================
 
-#define MAX_LISTS 65536
+// Most lists stay short (coordinate pairs, scan_area rows, call args), so the
+// first few items live in the slot and only longer lists spill to the heap.
+#define LIST_INLINE_ITEMS 8
 
 typedef struct {
-  Value *items;
+  Value inline_items[LIST_INLINE_ITEMS];
+  Value *spill; // GC-allocated items once count > LIST_INLINE_ITEMS
   int count;
   int capacity;
   int in_use;
-  int marked; // For GC
+  int marked;      // For GC
+  int remembered;  // Old and logged in gc_remembered since the last minor
+  int encoding;    // On the encoder's current path (cycle check)
+  int next_free;   // Free-list link while !in_use
 } List;
 
-static List lists[MAX_LISTS];
-static int lists_initialized = 0;
+static List *lists = NULL;
+static int list_table_size = 0;
+static int list_free_head = 0; // 0 = free list empty
 
-static void init_lists(void) {
-  if (lists_initialized)
-    return;
-  memset(lists, 0, sizeof(lists));
-  lists_initialized = 1;
+// All items live contiguously in whichever storage is current
+static inline Value *list_items(List *l) {
+  return l->spill ? l->spill : l->inline_items;
+}
+
+// Slot of a live list handle, or NULL
+static List *list_of(Value list_val) {
+  long handle = AS_INT(list_val);
+  if ((handle & TYPE_MASK_LIST) != TYPE_MASK_LIST)
+    return NULL;
+  long list = handle & ~TYPE_MASK_LIST;
+  if (list <= 0 || list >= list_table_size || !lists[list].in_use)
+    return NULL;
+  return &lists[list];
+}
+
+static int grow_lists(void) {
+  int old_size = list_table_size;
+  List *grown = handle_table_grow(lists, &list_table_size, sizeof(List));
+  if (!grown)
+    return 0;
+  lists = grown;
+  for (int i = list_table_size - 1; i >= old_size && i > 0; i--) {
+    lists[i].next_free = list_free_head;
+    list_free_head = i;
+  }
+  return 1;
 }
 
 Value ds_list_create(void) {
-  init_lists();
-  for (int i = 1; i < MAX_LISTS; i++) {
-    if (!lists[i].in_use) {
-      lists[i].in_use = 1;
-      lists[i].marked = 0;
-      lists[i].count = 0;
-      lists[i].capacity = 16;
-      lists[i].items = (Value *)gc_alloc(lists[i].capacity * sizeof(Value),
-                                         GC_TYPE_LIST_ITEMS);
-      return VAL_INT(i | TYPE_MASK_LIST);
-    }
+  if (list_free_head == 0 && !grow_lists()) {
+    gc_alloc_failed("list table");
+    return VAL_INT(0);
+  }
+  int i = list_free_head;
+  list_free_head = lists[i].next_free;
+  lists[i].in_use = 1;
+  lists[i].marked = gc_alloc_mark;
+  lists[i].remembered = 0;
+  lists[i].count = 0;
+  lists[i].capacity = LIST_INLINE_ITEMS;
+  lists[i].spill = NULL;
+  gc_log_young(&gc_young_lists, i);
+  gc_account_alloc(sizeof(List));
+  gc_stats.lists++;
+  gc_stats.allocations++;
+  return VAL_INT(i | TYPE_MASK_LIST);
+}
+
+// Write barrier for a store into lists[idx] (see object_barrier)
+static inline void list_barrier(long idx, Value value) {
+  gc_write_barrier(value);
+  List *l = &lists[idx];
+  if (l->marked == gc_epoch && !l->remembered && gc_phase == GC_IDLE &&
+      GC_IS_REF(value)) {
+    l->remembered = 1;
+    if (!gc_log_push(&gc_remembered, VAL_INT(idx | TYPE_MASK_LIST)))
+      gc_nursery_lost = 1;
   }
-  return VAL_INT(0);
+}
+
+// Move the items to a spill buffer of at least min_capacity. Growth is 1.5x
+// rounded up to whatever the size class holds anyway, so short lists take a
+// few small cells instead of jumping straight to double; 0 on OOM.
+static int list_grow(List *l, size_t min_capacity) {
+  size_t want = (size_t)l->capacity + l->capacity / 2;
+  if (want < min_capacity)
+    want = min_capacity;
+  size_t bytes = gc_usable_size(want * sizeof(Value));
+  Value *new_items = (Value *)gc_alloc(bytes, GC_TYPE_LIST_ITEMS);
+  if (!new_items)
+    return 0;
+  memcpy(new_items, list_items(l), l->count * sizeof(Value));
+  // Old buffer is unreachable now; return it to the heap
+  if (l->spill)
+    gc_free(l->spill);
+  // An old list's buffer is old too: minors don't trace old lists
+  if (l->marked == gc_epoch)
+    ((GcHeader *)new_items - 1)->marked = gc_epoch;
+  l->spill = new_items;
+  l->capacity = (int)(bytes / sizeof(Value));
+  return 1;
 }
 
 Value ds_list_push(Value list_val, Value value) {
@@ -695,30 +1703,16 @@ Value ds_list_push(Value list_val, Value value) {
     return VAL_INT(0);
   long list = handle & ~TYPE_MASK_LIST;
 
-  if (list <= 0 || list >= MAX_LISTS)
+  if (list <= 0 || list >= list_table_size)
     return VAL_INT(0);
   if (!lists[list].in_use)
     return VAL_INT(0);
 
-  if (lists[list].count >= lists[list].capacity) {
-    // Allocate new larger buffer via GC
-    int new_capacity = lists[list].capacity * 2;
-    Value *new_items =
-        (Value *)gc_alloc(new_capacity * sizeof(Value), GC_TYPE_LIST_ITEMS);
-    if (new_items) {
-      // Copy old items
-      memcpy(new_items, lists[list].items, lists[list].count * sizeof(Value));
-      // Unregister old allocation from GC and free it
-      gc_unregister(lists[list].items);
-      free(lists[list].items);
-      lists[list].items = new_items;
-      lists[list].capacity = new_capacity;
-    } else {
-      // Allocation failed, cannot add item
-      return VAL_INT(0);
-    }
-  }
-  lists[list].items[lists[list].count++] = value;
+  if (lists[list].count >= lists[list].capacity &&
+      !list_grow(&lists[list], lists[list].count + 1))
+    return VAL_INT(0); // Allocation failed, cannot add item
+  list_barrier(list, value);
+  list_items(&lists[list])[lists[list].count++] = value;
   return VAL_INT(0);
 }
 
@@ -729,14 +1723,14 @@ Value ds_list_get(Value list_val, Value index_val) {
   long list = handle & ~TYPE_MASK_LIST;
 
   long index = AS_INT(index_val);
-  if (list <= 0 || list >= MAX_LISTS)
+  if (list <= 0 || list >= list_table_size)
     return VAL_INT(0);
   if (!lists[list].in_use)
     return VAL_INT(0);
   if (index < 0 || index >= lists[list].count)
     return VAL_INT(0);
 
-  return lists[list].items[index];
+  return list_items(&lists[list])[index];
 }
 
 Value ds_list_len(Value list_val) {
@@ -745,197 +1739,1272 @@ Value ds_list_len(Value list_val) {
     return VAL_INT(0);
   long list = handle & ~TYPE_MASK_LIST;
 
-  if (list <= 0 || list >= MAX_LISTS)
+  if (list <= 0 || list >= list_table_size)
     return VAL_INT(0);
   if (!lists[list].in_use)
     return VAL_INT(0);
   return VAL_INT(lists[list].count);
 }
 
-// Check if a value is a valid list handle
-Value ds_is_list(Value val) {
-  if (!IS_INT(val))
-    return VAL_INT(0);
-  long handle = AS_INT(val);
-  if ((handle & TYPE_MASK_LIST) != TYPE_MASK_LIST)
-    return VAL_INT(0);
-  long id = handle & ~TYPE_MASK_LIST;
+// Overwrite the item at index; out-of-range indices are ignored
+Value ds_list_set(Value list_val, Value index_val, Value value) {
+  List *l = list_of(list_val);
+  long index = AS_INT(index_val);
+  if (!l || index < 0 || index >= l->count)
+    return VAL_INT(0);
+  list_barrier(l - lists, value);
+  list_items(l)[index] = value;
+  return VAL_INT(0);
+}
+
+// Remove and return the last item; 0 if the list is empty
+Value ds_list_pop(Value list_val) {
+  List *l = list_of(list_val);
+  if (!l || l->count == 0)
+    return VAL_INT(0);
+  return list_items(l)[--l->count];
+}
+
+// Insert before index (index == length appends), shifting the tail up
+Value ds_list_insert(Value list_val, Value index_val, Value value) {
+  List *l = list_of(list_val);
+  long index = AS_INT(index_val);
+  if (!l || index < 0 || index > l->count)
+    return VAL_INT(0);
+  if (l->count >= l->capacity && !list_grow(l, l->count + 1))
+    return VAL_INT(0);
+  list_barrier(l - lists, value);
+  Value *items = list_items(l);
+  memmove(items + index + 1, items + index,
+          (l->count - index) * sizeof(Value));
+  items[index] = value;
+  l->count++;
+  return VAL_INT(0);
+}
+
+// Remove and return the item at index, shifting the tail down; 0 if out of
+// range
+Value ds_list_remove(Value list_val, Value index_val) {
+  List *l = list_of(list_val);
+  long index = AS_INT(index_val);
+  if (!l || index < 0 || index >= l->count)
+    return VAL_INT(0);
+  Value *items = list_items(l);
+  Value removed = items[index];
+  memmove(items + index, items + index + 1,
+          (l->count - index - 1) * sizeof(Value));
+  l->count--;
+  return removed;
+}
+
+// New list with the items in [start, end), both clamped to the list. A copy
+// rather than a view, so the two lists can be changed independently.
+Value ds_list_slice(Value list_val, Value start_val, Value end_val) {
+  long start = AS_INT(start_val);
+  long end = AS_INT(end_val);
+  List *src = list_of(list_val);
+  long count = src ? src->count : 0;
+  if (start < 0)
+    start = 0;
+  if (end > count)
+    end = count;
+
+  Value result = ds_list_create();
+  if (start >= end)
+    return result;
+  ds_list_reserve(result, VAL_INT(end - start));
+  // Creating the list may have moved the table
+  src = list_of(list_val);
+  for (long i = start; i < end; i++)
+    ds_list_push(result, list_items(src)[i]);
+  return result;
+}
+
+// Make room for capacity items without further allocation; 1 on success
+Value ds_list_reserve(Value list_val, Value capacity_val) {
+  List *l = list_of(list_val);
+  long capacity = AS_INT(capacity_val);
+  if (!l || capacity > INT_MAX / (long)sizeof(Value))
+    return VAL_INT(0);
+  if (capacity <= l->capacity)
+    return VAL_INT(1);
+  return VAL_INT(list_grow(l, capacity));
+}
+
+// Drop every item; the spilled buffer is kept for refilling
+Value ds_list_clear(Value list_val) {
+  List *l = list_of(list_val);
+  if (l)
+    l->count = 0;
+  return VAL_INT(0);
+}
+
+// Check if a value is a valid list handle
+Value ds_is_list(Value val) {
+  if (!IS_INT(val))
+    return VAL_INT(0);
+  long handle = AS_INT(val);
+  if ((handle & TYPE_MASK_LIST) != TYPE_MASK_LIST)
+    return VAL_INT(0);
+  long id = handle & ~TYPE_MASK_LIST;
+
+  if (id <= 0 || id >= list_table_size)
+    return VAL_INT(0);
+  return VAL_INT(lists[id].in_use);
+}
+
+// Check if a value is a valid object handle (a map is not, though it shares
+// the handle space)
+Value ds_is_object(Value val) {
+  if (!IS_INT(val))
+    return VAL_INT(0);
+  long handle = AS_INT(val);
+  if ((handle & TYPE_MASK_OBJ) != TYPE_MASK_OBJ)
+    return VAL_INT(0);
+  long id = handle & ~TYPE_MASK_OBJ;
+
+  if (id <= 0 || id >= object_table_size)
+    return VAL_INT(0);
+  return VAL_INT(objects[id].in_use && !objects[id].map);
+}
+
+// ============================================================================
+// Maps
+// A map is an object slot holding an open-addressed hash table instead of
+// props, so it shares the object handles, write barriers and sweep. Keys are
+// strings (compared by content) or ints, handles included. The table is one
+// GC block: a MapTable header, then a power-of-two count of entries probed
+// linearly and kept at most half full, as misses (an evaluator looking a
+// name up through its enclosing scopes) run to the next empty entry. A
+// delete leaves a tombstone until the table is next rebuilt.
+// ============================================================================
+
+#define MAP_MIN_CAPACITY 8
+#define MAP_EMPTY 0     // Key of an entry never used
+#define MAP_TOMBSTONE 2 // Key of a deleted entry (neither an int nor a string)
+#define MAP_LIVE(k) ((k) != MAP_EMPTY && (k) != MAP_TOMBSTONE)
+
+typedef struct {
+  Value key;
+  Value value;
+  uint32_t hash; // Of key, so probes pass other keys without reading them
+} MapEntry;
+
+typedef struct MapTable {
+  int count;    // Live entries
+  int used;     // Live entries and tombstones
+  int capacity; // Power of 2, kept at least twice used
+  int pad;
+  MapEntry entries[];
+} MapTable;
+
+// Strings hash by content (the cached hash), ints by a multiplicative mix
+static inline uint32_t map_hash(Value key) {
+  if (IS_OBJ(key))
+    return str_hash(key);
+  return (uint32_t)(((uint64_t)key * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+static inline int map_key_ok(Value key) {
+  return MAP_LIVE(key) && !IS_ARRAY(key);
+}
+
+// The entry holding key, or else the one it would go in: the first tombstone
+// on its probe path, or the empty entry that ends it
+static MapEntry *map_probe(MapTable *t, Value key, uint32_t hash) {
+  uint32_t mask = (uint32_t)t->capacity - 1;
+  MapEntry *tomb = NULL;
+  for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+    MapEntry *e = &t->entries[i];
+    if (e->key == MAP_EMPTY)
+      return tomb ? tomb : e;
+    if (e->key == MAP_TOMBSTONE) {
+      if (!tomb)
+        tomb = e;
+    } else if (e->hash == hash &&
+               (e->key == key ||
+                (IS_OBJ(key) && IS_OBJ(e->key) && str_equal(e->key, key)))) {
+      return e;
+    }
+  }
+}
+
+static MapTable *map_table_alloc(int capacity) {
+  size_t bytes = sizeof(MapTable) + (size_t)capacity * sizeof(MapEntry);
+  MapTable *t = gc_alloc(bytes, GC_TYPE_MAP);
+  if (!t)
+    return NULL;
+  memset(t, 0, bytes);
+  t->capacity = capacity;
+  return t;
+}
+
+// Move the live entries to a new table with room to spare for one more,
+// dropping tombstones; 0 on OOM
+static int map_rebuild(Object *o) {
+  MapTable *old = o->map;
+  int capacity = MAP_MIN_CAPACITY;
+  while (capacity < (old->count + 1) * 4)
+    capacity *= 2;
+  MapTable *t = map_table_alloc(capacity);
+  if (!t)
+    return 0;
+  for (int i = 0; i < old->capacity; i++) {
+    MapEntry *e = &old->entries[i];
+    if (!MAP_LIVE(e->key))
+      continue;
+    *map_probe(t, e->key, e->hash) = *e;
+  }
+  t->count = t->used = old->count;
+  gc_free(old);
+  // An old map's table is old too (see list_grow)
+  if (o->marked == gc_epoch)
+    ((GcHeader *)t - 1)->marked = gc_epoch;
+  o->map = t;
+  return 1;
+}
+
+// Resolve a map handle to its object slot, or 0 if it isn't a live map
+static inline long map_index(Value map_val) {
+  long idx = object_index(map_val);
+  return idx && objects[idx].map ? idx : 0;
+}
+
+Value ds_map_create(void) {
+  int idx = alloc_object_idx();
+  if (idx == 0)
+    return VAL_INT(0);
+  MapTable *t = map_table_alloc(MAP_MIN_CAPACITY);
+  if (!t)
+    return VAL_INT(0); // The bare slot is unreachable; the next sweep takes it
+  objects[idx].map = t;
+  objects[idx].shape = SHAPE_DICT;
+  return VAL_INT(idx | TYPE_MASK_OBJ);
+}
+
+Value ds_is_map(Value val) {
+  return VAL_INT(IS_INT(val) && map_index(val) != 0);
+}
+
+Value ds_map_size(Value map_val) {
+  long idx = map_index(map_val);
+  return VAL_INT(idx ? objects[idx].map->count : 0);
+}
+
+// 0 for a missing key, as for a missing prop
+Value ds_map_get(Value map_val, Value key) {
+  long idx = map_index(map_val);
+  if (idx == 0 || !map_key_ok(key))
+    return VAL_INT(0);
+  MapEntry *e = map_probe(objects[idx].map, key, map_hash(key));
+  return MAP_LIVE(e->key) ? e->value : VAL_INT(0);
+}
+
+Value ds_map_has(Value map_val, Value key) {
+  long idx = map_index(map_val);
+  if (idx == 0 || !map_key_ok(key))
+    return VAL_INT(0);
+  MapEntry *e = map_probe(objects[idx].map, key, map_hash(key));
+  return VAL_INT(MAP_LIVE(e->key));
+}
+
+Value ds_map_set(Value map_val, Value key, Value value) {
+  long idx = map_index(map_val);
+  if (idx == 0 || !map_key_ok(key))
+    return VAL_INT(0);
+  Object *o = &objects[idx];
+  uint32_t hash = map_hash(key);
+  MapEntry *e = map_probe(o->map, key, hash);
+  if (!MAP_LIVE(e->key)) {
+    if (e->key == MAP_EMPTY && (o->map->used + 1) * 2 > o->map->capacity) {
+      if (!map_rebuild(o))
+        return VAL_INT(0);
+      e = map_probe(o->map, key, hash);
+    }
+    if (e->key == MAP_EMPTY)
+      o->map->used++;
+    o->map->count++;
+    object_barrier(idx, key);
+    e->key = key;
+    e->hash = hash;
+  }
+  object_barrier(idx, value);
+  e->value = value;
+  return VAL_INT(0);
+}
+
+// 1 if key was there
+Value ds_map_delete(Value map_val, Value key) {
+  long idx = map_index(map_val);
+  if (idx == 0 || !map_key_ok(key))
+    return VAL_INT(0);
+  MapTable *t = objects[idx].map;
+  MapEntry *e = map_probe(t, key, map_hash(key));
+  if (!MAP_LIVE(e->key))
+    return VAL_INT(0);
+  e->key = MAP_TOMBSTONE;
+  e->value = VAL_INT(0);
+  // Emptied: no probe path needs its tombstones any more
+  if (--t->count == 0) {
+    memset(t->entries, 0, (size_t)t->capacity * sizeof(MapEntry));
+    t->used = 0;
+  }
+  return VAL_INT(1);
+}
+
+// Drops the entries, keeping the table's capacity
+Value ds_map_clear(Value map_val) {
+  long idx = map_index(map_val);
+  if (idx == 0)
+    return VAL_INT(0);
+  MapTable *t = objects[idx].map;
+  memset(t->entries, 0, (size_t)t->capacity * sizeof(MapEntry));
+  t->count = t->used = 0;
+  return VAL_INT(0);
+}
+
+// Iteration: positions are entry indexes. ds_map_next gives the first live
+// entry at or after pos, or -1 past the end; the order is the table's and
+// changes when a set grows it.
+Value ds_map_next(Value map_val, Value pos_val) {
+  long idx = map_index(map_val);
+  if (idx == 0 || !IS_INT(pos_val))
+    return VAL_INT(-1);
+  MapTable *t = objects[idx].map;
+  for (long i = AS_INT(pos_val) < 0 ? 0 : AS_INT(pos_val); i < t->capacity;
+       i++) {
+    if (MAP_LIVE(t->entries[i].key))
+      return VAL_INT(i);
+  }
+  return VAL_INT(-1);
+}
+
+// The live entry at pos, or NULL
+static MapEntry *map_entry_at(Value map_val, Value pos_val) {
+  long idx = map_index(map_val);
+  if (idx == 0 || !IS_INT(pos_val))
+    return NULL;
+  MapTable *t = objects[idx].map;
+  long pos = AS_INT(pos_val);
+  if (pos < 0 || pos >= t->capacity || !MAP_LIVE(t->entries[pos].key))
+    return NULL;
+  return &t->entries[pos];
+}
+
+Value ds_map_key_at(Value map_val, Value pos_val) {
+  MapEntry *e = map_entry_at(map_val, pos_val);
+  return e ? e->key : VAL_INT(0);
+}
+
+Value ds_map_value_at(Value map_val, Value pos_val) {
+  MapEntry *e = map_entry_at(map_val, pos_val);
+  return e ? e->value : VAL_INT(0);
+}
+
+// A new list of the keys (values) in iteration order
+static Value map_collect(Value map_val, int values) {
+  Value list = ds_list_create();
+  long idx = map_index(map_val);
+  if (idx == 0)
+    return list;
+  MapTable *t = objects[idx].map;
+  ds_list_reserve(list, VAL_INT(t->count));
+  for (int i = 0; i < t->capacity; i++) {
+    MapEntry *e = &t->entries[i];
+    if (MAP_LIVE(e->key))
+      ds_list_push(list, values ? e->value : e->key);
+  }
+  return list;
+}
+
+Value ds_map_keys(Value map_val) { return map_collect(map_val, 0); }
+
+Value ds_map_values(Value map_val) { return map_collect(map_val, 1); }
+
+// ============================================================================
+// Typed Arrays
+// One GC block each: the ArrayHeader, then the elements. Nothing in an array
+// is a reference, so marking one is marking its block, as for a string.
+// ============================================================================
+
+#define ARRAY_MAX_COUNT (1 << 24)
+
+static const uint8_t array_elem_size[] = {0, 4, 1, 4}; // By kind
+
+static inline int array_kind(ArrayHeader *h) { return h->tag & ~ARRAY_TAG; }
+
+static ArrayHeader *array_of(Value arr) {
+  return IS_ARRAY(arr) ? ARRAY_HEADER(arr) : NULL;
+}
+
+static Value array_create(int kind, Value count_val) {
+  long count = AS_INT(count_val);
+  if (!IS_INT(count_val) || count < 0 || count > ARRAY_MAX_COUNT)
+    return VAL_INT(0);
+  size_t bytes = (size_t)count * array_elem_size[kind];
+  ArrayHeader *h = gc_alloc(sizeof(ArrayHeader) + bytes, GC_TYPE_ARRAY);
+  if (!h)
+    return VAL_INT(0);
+  h->tag = ARRAY_TAG | kind;
+  h->count = (uint32_t)count;
+  memset(h + 1, 0, bytes);
+  return VAL_OBJ(h + 1);
+}
+
+Value ds_array_int32(Value count) { return array_create(ARRAY_INT32, count); }
+Value ds_array_uint8(Value count) { return array_create(ARRAY_UINT8, count); }
+Value ds_array_float32(Value count) {
+  return array_create(ARRAY_FLOAT32, count);
+}
+
+Value ds_is_array(Value val) { return VAL_INT(IS_ARRAY(val)); }
+
+Value ds_array_len(Value arr) {
+  ArrayHeader *h = array_of(arr);
+  return VAL_INT(h ? h->count : 0);
+}
+
+static long array_load(ArrayHeader *h, long i) {
+  switch (array_kind(h)) {
+  case ARRAY_INT32:
+    return ((int32_t *)(h + 1))[i];
+  case ARRAY_UINT8:
+    return ((uint8_t *)(h + 1))[i];
+  default:
+    return (long)((float *)(h + 1))[i];
+  }
+}
+
+static void array_store(ArrayHeader *h, long i, long value) {
+  switch (array_kind(h)) {
+  case ARRAY_INT32:
+    ((int32_t *)(h + 1))[i] = (int32_t)value;
+    break;
+  case ARRAY_UINT8:
+    ((uint8_t *)(h + 1))[i] = (uint8_t)value;
+    break;
+  default:
+    ((float *)(h + 1))[i] = (float)value;
+    break;
+  }
+}
+
+static double array_load_float(ArrayHeader *h, long i) {
+  if (array_kind(h) == ARRAY_FLOAT32)
+    return ((float *)(h + 1))[i];
+  return (double)array_load(h, i);
+}
+
+static void array_store_float(ArrayHeader *h, long i, double value) {
+  if (array_kind(h) == ARRAY_FLOAT32)
+    ((float *)(h + 1))[i] = (float)value;
+  else
+    array_store(h, i, (long)value);
+}
+
+// Clamp [start, end) to the array; 0 if nothing is left of it
+static int array_range(ArrayHeader *h, Value start_val, Value end_val,
+                       long *start, long *end) {
+  *start = AS_INT(start_val);
+  *end = AS_INT(end_val);
+  if (*start < 0)
+    *start = 0;
+  if (*end > (long)h->count)
+    *end = h->count;
+  return *start < *end;
+}
+
+Value ds_array_get(Value arr, Value index_val) {
+  ArrayHeader *h = array_of(arr);
+  long index = AS_INT(index_val);
+  if (!h || index < 0 || index >= (long)h->count)
+    return VAL_INT(0);
+  return VAL_INT(array_load(h, index));
+}
+
+Value ds_array_set(Value arr, Value index_val, Value value) {
+  ArrayHeader *h = array_of(arr);
+  long index = AS_INT(index_val);
+  if (h && index >= 0 && index < (long)h->count)
+    array_store(h, index, AS_INT(value));
+  return VAL_INT(0);
+}
+
+double ds_array_get_float(Value arr, Value index_val) {
+  ArrayHeader *h = array_of(arr);
+  long index = AS_INT(index_val);
+  if (!h || index < 0 || index >= (long)h->count)
+    return 0.0;
+  return array_load_float(h, index);
+}
+
+void ds_array_set_float(Value arr, Value index_val, float value) {
+  ArrayHeader *h = array_of(arr);
+  long index = AS_INT(index_val);
+  if (h && index >= 0 && index < (long)h->count)
+    array_store_float(h, index, value);
+}
+
+Value ds_array_fill(Value arr, Value value, Value start_val, Value end_val) {
+  ArrayHeader *h = array_of(arr);
+  long start, end;
+  if (!h || !array_range(h, start_val, end_val, &start, &end))
+    return VAL_INT(0);
+  long v = AS_INT(value);
+  switch (array_kind(h)) {
+  case ARRAY_INT32:
+    for (long i = start; i < end; i++)
+      ((int32_t *)(h + 1))[i] = (int32_t)v;
+    break;
+  case ARRAY_UINT8:
+    memset((uint8_t *)(h + 1) + start, (uint8_t)v, end - start);
+    break;
+  default:
+    for (long i = start; i < end; i++)
+      ((float *)(h + 1))[i] = (float)v;
+    break;
+  }
+  return VAL_INT(0);
+}
+
+Value ds_array_fill_float(Value arr, float value, Value start_val,
+                          Value end_val) {
+  ArrayHeader *h = array_of(arr);
+  long start, end;
+  if (!h || !array_range(h, start_val, end_val, &start, &end))
+    return VAL_INT(0);
+  if (array_kind(h) != ARRAY_FLOAT32)
+    return ds_array_fill(arr, VAL_INT((long)value), start_val, end_val);
+  for (long i = start; i < end; i++)
+    ((float *)(h + 1))[i] = value;
+  return VAL_INT(0);
+}
+
+Value ds_array_add(Value arr, Value delta, Value start_val, Value end_val) {
+  ArrayHeader *h = array_of(arr);
+  long start, end;
+  if (!h || !array_range(h, start_val, end_val, &start, &end))
+    return VAL_INT(0);
+  long d = AS_INT(delta);
+  switch (array_kind(h)) {
+  case ARRAY_INT32:
+    for (long i = start; i < end; i++)
+      ((int32_t *)(h + 1))[i] += (int32_t)d;
+    break;
+  case ARRAY_UINT8:
+    for (long i = start; i < end; i++)
+      ((uint8_t *)(h + 1))[i] += (uint8_t)d;
+    break;
+  default:
+    for (long i = start; i < end; i++)
+      ((float *)(h + 1))[i] += (float)d;
+    break;
+  }
+  return VAL_INT(0);
+}
+
+Value ds_array_min_index(Value arr, Value start_val, Value end_val) {
+  ArrayHeader *h = array_of(arr);
+  long start, end;
+  if (!h || !array_range(h, start_val, end_val, &start, &end))
+    return VAL_INT(-1);
+  long best = start;
+  switch (array_kind(h)) {
+  case ARRAY_INT32: {
+    int32_t *data = (int32_t *)(h + 1);
+    for (long i = start + 1; i < end; i++)
+      if (data[i] < data[best])
+        best = i;
+    break;
+  }
+  case ARRAY_UINT8: {
+    uint8_t *data = (uint8_t *)(h + 1);
+    for (long i = start + 1; i < end; i++)
+      if (data[i] < data[best])
+        best = i;
+    break;
+  }
+  default: {
+    float *data = (float *)(h + 1);
+    for (long i = start + 1; i < end; i++)
+      if (data[i] < data[best])
+        best = i;
+    break;
+  }
+  }
+  return VAL_INT(best);
+}
+
+Value ds_array_copy(Value dst, Value at_val, Value src, Value start_val,
+                    Value end_val) {
+  ArrayHeader *d = array_of(dst), *s = array_of(src);
+  long start, end;
+  if (!d || !s || !array_range(s, start_val, end_val, &start, &end))
+    return VAL_INT(0);
+  long at = AS_INT(at_val);
+  if (at < 0 || at >= (long)d->count)
+    return VAL_INT(0);
+  if (end - start > (long)d->count - at)
+    end = start + (d->count - at);
+
+  if (array_kind(d) == array_kind(s)) {
+    size_t size = array_elem_size[array_kind(s)];
+    memmove((char *)(d + 1) + at * size, (char *)(s + 1) + start * size,
+            (end - start) * size);
+  } else {
+    // Different kinds are different blocks, so there is no overlap
+    for (long i = start; i < end; i++)
+      array_store_float(d, at + i - start, array_load_float(s, i));
+  }
+  return VAL_INT(0);
+}
+
+// ============================================================================
+// Value Encoder
+// Renders values as text, either for display ({x: 1, tags: ["a"]}, what print
+// shows) or as JSON (quoted keys, escaped strings). Output goes to a growable
+// buffer, or in chunks to a sink. Nesting is walked with an explicit stack,
+// so depth is bounded by memory; a container met again on its own path is a
+// cycle and is written as "..." (display) or null (JSON).
+// ============================================================================
+
+#define ENC_CHUNK 4096 // Sink flush size, and the buffer's first capacity
+
+typedef struct {
+  long index; // Object or list slot
+  int is_list;
+  int next;   // Next prop/item (or map entry) to write
+  int wrote;  // Members written so far
+} EncFrame;
+
+typedef struct {
+  char *buf;
+  size_t len;
+  size_t cap;
+  int failed; // Out of memory: output stops, what was written is kept
+  int json;
+  EncSink sink; // If set, buf holds at most one chunk and is flushed to it
+  void *sink_ctx;
+} Encoder;
+
+// Scratch reused across encodes; both only grow
+static char *enc_buf = NULL;
+static size_t enc_buf_cap = 0;
+static EncFrame *enc_stack = NULL;
+static int enc_stack_cap = 0;
+
+// Make room for n more bytes in a growable buffer
+static int enc_reserve(Encoder *e, size_t n) {
+  if (e->len + n <= e->cap)
+    return 1;
+  size_t cap = e->cap ? e->cap : ENC_CHUNK;
+  while (cap < e->len + n)
+    cap *= 2;
+  char *grown = realloc(e->buf, cap);
+  if (!grown) {
+    e->failed = 1;
+    return 0;
+  }
+  e->buf = enc_buf = grown;
+  e->cap = enc_buf_cap = cap;
+  return 1;
+}
+
+static void enc_write(Encoder *e, const char *s, size_t n) {
+  if (e->failed)
+    return;
+  if (e->sink) {
+    // Fill the chunk and flush it until the rest fits, however long s is
+    while (e->len + n > e->cap) {
+      size_t part = e->cap - e->len;
+      memcpy(e->buf + e->len, s, part);
+      e->sink(e->buf, e->cap, e->sink_ctx);
+      e->len = 0;
+      s += part;
+      n -= part;
+    }
+  } else if (!enc_reserve(e, n)) {
+    return;
+  }
+  memcpy(e->buf + e->len, s, n);
+  e->len += n;
+}
+
+static inline void enc_char(Encoder *e, char c) {
+  if (e->len < e->cap) {
+    e->buf[e->len++] = c;
+    return;
+  }
+  enc_write(e, &c, 1);
+}
+
+// Decimal digits without snprintf
+static void enc_int(Encoder *e, long n) {
+  char digits[24];
+  char *p = digits + sizeof(digits);
+  unsigned long u = n < 0 ? 0UL - (unsigned long)n : (unsigned long)n;
+  do {
+    *--p = (char)('0' + u % 10);
+    u /= 10;
+  } while (u);
+  if (n < 0)
+    *--p = '-';
+  enc_write(e, p, digits + sizeof(digits) - p);
+}
+
+// A quoted string; JSON mode escapes quotes, backslashes and control chars
+static void enc_string(Encoder *e, const char *s, size_t n) {
+  enc_char(e, '"');
+  if (!e->json) {
+    enc_write(e, s, n);
+    enc_char(e, '"');
+    return;
+  }
+  size_t run = 0; // Start of the pending run of chars needing no escape
+  for (size_t i = 0; i < n; i++) {
+    unsigned char c = (unsigned char)s[i];
+    if (c >= 0x20 && c != '"' && c != '\\')
+      continue;
+    enc_write(e, s + run, i - run);
+    run = i + 1;
+    char esc[6] = {'\\', (char)c, 0, 0, 0, 0};
+    size_t len = 2;
+    if (c == '\n')
+      esc[1] = 'n';
+    else if (c == '\r')
+      esc[1] = 'r';
+    else if (c == '\t')
+      esc[1] = 't';
+    else if (c < 0x20) {
+      static const char hex[] = "0123456789abcdef";
+      memcpy(esc + 1, "u00", 3);
+      esc[4] = hex[c >> 4];
+      esc[5] = hex[c & 15];
+      len = 6;
+    }
+    enc_write(e, esc, len);
+  }
+  enc_write(e, s + run, n - run);
+  enc_char(e, '"');
+}
+
+static int enc_push(int *depth, long index, int is_list) {
+  if (*depth >= enc_stack_cap) {
+    int cap = enc_stack_cap ? enc_stack_cap * 2 : 64;
+    EncFrame *grown = realloc(enc_stack, cap * sizeof(EncFrame));
+    if (!grown)
+      return 0;
+    enc_stack = grown;
+    enc_stack_cap = cap;
+  }
+  enc_stack[*depth].index = index;
+  enc_stack[*depth].is_list = is_list;
+  enc_stack[*depth].next = 0;
+  enc_stack[*depth].wrote = 0;
+  (*depth)++;
+  return 1;
+}
+
+// A typed array has no references, so it is written out whole
+static void enc_array(Encoder *e, ArrayHeader *h) {
+  enc_char(e, '[');
+  for (uint32_t i = 0; i < h->count; i++) {
+    if (i > 0)
+      enc_write(e, ", ", 2);
+    if ((h->tag & ~ARRAY_TAG) != ARRAY_FLOAT32) {
+      enc_int(e, array_load(h, i));
+      continue;
+    }
+    double f = array_load_float(h, i);
+    char num[32];
+    if (!isfinite(f) && e->json) {
+      enc_write(e, "null", 4);
+    } else {
+      int n = snprintf(num, sizeof(num), "%g", f);
+      enc_write(e, num, n);
+    }
+  }
+  enc_char(e, ']');
+}
+
+// Write a scalar, or open a container and push it. force_type applies to the
+// top-level value only: 1 = object, 2 = list (an untagged slot index is
+// accepted), 0/3 = whatever the handle says.
+static void enc_value(Encoder *e, Value val, int force_type, int *depth) {
+  if (!IS_INT(val)) {
+    if (!val)
+      enc_write(e, "null", 4);
+    else if (IS_ARRAY(val))
+      enc_array(e, ARRAY_HEADER(val));
+    else
+      enc_string(e, (const char *)AS_OBJ(val), str_length(val));
+    return;
+  }
+
+  long id = AS_INT(val);
+  long index = -1;
+  int is_list = 0;
+  int tagged_obj = (id & TYPE_MASK_OBJ) == TYPE_MASK_OBJ;
+  int tagged_list = (id & TYPE_MASK_LIST) == TYPE_MASK_LIST;
+  if (force_type == 1 || (force_type != 2 && tagged_obj)) {
+    long idx = id & ~TYPE_MASK_OBJ;
+    if (idx > 0 && idx < object_table_size && objects[idx].in_use)
+      index = idx;
+  }
+  if (index < 0 && (force_type == 2 || (force_type != 1 && tagged_list))) {
+    long idx = id & ~TYPE_MASK_LIST;
+    if (idx > 0 && idx < list_table_size && lists[idx].in_use) {
+      index = idx;
+      is_list = 1;
+    }
+  }
+  if (index < 0) {
+    enc_int(e, id);
+    return;
+  }
+
+  int *encoding = is_list ? &lists[index].encoding : &objects[index].encoding;
+  if (*encoding) {
+    if (e->json)
+      enc_write(e, "null", 4);
+    else
+      enc_write(e, "...", 3);
+    return;
+  }
+  if (!enc_push(depth, index, is_list)) {
+    e->failed = 1;
+    return;
+  }
+  *encoding = 1;
+  enc_char(e, is_list ? '[' : '{');
+}
+
+static void encode(Encoder *e, Value val, int force_type) {
+  int depth = 0;
+  enc_value(e, val, force_type, &depth);
+  while (depth > 0) {
+    EncFrame *f = &enc_stack[depth - 1];
+    long index = f->index;
+    MapTable *map = f->is_list ? NULL : objects[index].map;
+    int count = f->is_list ? lists[index].count
+                : map      ? map->capacity
+                           : objects[index].prop_count;
+    if (f->next >= count || e->failed) {
+      if (f->is_list)
+        lists[index].encoding = 0;
+      else
+        objects[index].encoding = 0;
+      enc_char(e, f->is_list ? ']' : '}');
+      depth--;
+      continue;
+    }
+    int i = f->next++;
+    if (map && !MAP_LIVE(map->entries[i].key))
+      continue;
+    if (f->wrote++ > 0)
+      enc_write(e, ", ", 2);
+    Value item;
+    if (f->is_list) {
+      item = list_items(&lists[index])[i];
+    } else if (map) {
+      // String keys as prop names; int keys bare, or quoted in JSON
+      Value key = map->entries[i].key;
+      if (IS_OBJ(key)) {
+        if (e->json)
+          enc_string(e, (const char *)AS_OBJ(key), str_length(key));
+        else
+          enc_write(e, (const char *)AS_OBJ(key), str_length(key));
+      } else {
+        if (e->json)
+          enc_char(e, '"');
+        enc_int(e, AS_INT(key));
+        if (e->json)
+          enc_char(e, '"');
+      }
+      enc_write(e, ": ", 2);
+      item = map->entries[i].value;
+    } else {
+      Property *prop = &object_props(&objects[index])[i];
+      const char *key = ds_atom_name(prop->key);
+      size_t key_len = STR_HEADER(key)->length;
+      if (e->json) {
+        enc_string(e, key, key_len);
+      } else {
+        enc_write(e, key, key_len);
+      }
+      enc_write(e, ": ", 2);
+      item = prop->value;
+    }
+    enc_value(e, item, 0, &depth); // f may move when this pushes
+  }
+}
+
+// Encode to a heap string
+static Value encode_to_string(Value val, int force_type, int json) {
+  Encoder e = {enc_buf, 0, enc_buf_cap, 0, json, NULL, NULL};
+  encode(&e, val, force_type);
+  return str_from(e.buf, e.len);
+}
 
-  if (id <= 0 || id >= MAX_LISTS)
-    return VAL_INT(0);
-  return VAL_INT(lists[id].in_use);
+void ds_json_write(Value val, EncSink sink, void *ctx) {
+  char chunk[ENC_CHUNK];
+  Encoder e = {chunk, 0, sizeof(chunk), 0, 1, sink, ctx};
+  encode(&e, val, 0);
+  if (e.len)
+    sink(e.buf, e.len, ctx);
 }
 
-// Check if a value is a valid object handle
-Value ds_is_object(Value val) {
-  if (!IS_INT(val))
-    return VAL_INT(0);
-  long handle = AS_INT(val);
-  if ((handle & TYPE_MASK_OBJ) != TYPE_MASK_OBJ)
-    return VAL_INT(0);
-  long id = handle & ~TYPE_MASK_OBJ;
+Value ds_list_to_string(Value list_val) {
+  return encode_to_string(list_val, 2, 0);
+}
 
-  if (id <= 0 || id >= MAX_OBJECTS)
-    return VAL_INT(0);
-  return VAL_INT(objects[id].in_use);
+Value ds_object_to_string(Value obj_val) {
+  return encode_to_string(obj_val, 1, 0);
 }
 
-// Convert a list to a string representation "[a, b, c]"
-// Handles nested lists recursively with depth limit
-// Helper for recursion
-static void val_to_string_recursive(Value val, char *buf, int buf_size,
-                                    int *pos, int depth, int force_type) {
-  if (depth > 10) {
-    int len = snprintf(buf + *pos, buf_size - *pos, "...");
-    *pos += len;
-    return;
-  }
+Value ds_val_to_string(Value val) { return encode_to_string(val, 0, 0); }
 
-  if (!IS_INT(val)) {
-    // String
-    const char *str = (const char *)AS_OBJ(val);
-    if (str) {
-      int len = snprintf(buf + *pos, buf_size - *pos, "\"%s\"", str);
-      *pos += len;
-    } else {
-      int len = snprintf(buf + *pos, buf_size - *pos, "null");
-      *pos += len;
-    }
-    return;
-  }
+Value ds_json_encode(Value val) { return encode_to_string(val, 0, 1); }
 
-  long id = AS_INT(val);
+// ============================================================================
+// JSON Decoder
+// Parses JSON text straight into runtime values: objects become maps keyed by
+// heap strings (so any number of keys, and no atoms made), arrays ds_lists,
+// strings heap strings (\u escapes as UTF-8), numbers ints (any fraction is
+// dropped), true/false 1/0 and null 0. Malformed input, or nesting deeper
+// than JSON_MAX_DEPTH, decodes to 0.
+// ============================================================================
 
-  long obj_idx = -1;
-  long list_idx = -1;
+#define JSON_MAX_DEPTH 512
 
-  if ((id & TYPE_MASK_OBJ) == TYPE_MASK_OBJ) {
-    obj_idx = id & ~TYPE_MASK_OBJ;
-  } else if ((id & TYPE_MASK_LIST) == TYPE_MASK_LIST) {
-    list_idx = id & ~TYPE_MASK_LIST;
-  }
+typedef struct {
+  const char *p;
+  const char *end;
+  int failed;
+} Decoder;
 
-  // Auto Mode includes 0 and legacy 3
-  int is_auto = (force_type == 0 || force_type == 3);
+// Unescaped string chars; reused across decodes and only grows
+static char *dec_buf = NULL;
+static size_t dec_buf_cap = 0;
 
-  // Try Object
-  if ((force_type == 1) || (is_auto && obj_idx != -1)) {
-    long idx = (force_type == 1) ? id : obj_idx;
-    // Unwrap if forced handle provided
-    if ((idx & TYPE_MASK_OBJ) == TYPE_MASK_OBJ)
-      idx &= ~TYPE_MASK_OBJ;
+static void dec_skip_space(Decoder *d) {
+  while (d->p < d->end &&
+         (*d->p == ' ' || *d->p == '\n' || *d->p == '\r' || *d->p == '\t'))
+    d->p++;
+}
 
-    if (idx > 0 && idx < MAX_OBJECTS && objects[idx].in_use) {
-      int len = snprintf(buf + *pos, buf_size - *pos, "{");
-      *pos += len;
+static Value dec_fail(Decoder *d) {
+  d->failed = 1;
+  return VAL_INT(0);
+}
 
-      for (int i = 0; i < objects[idx].prop_count && *pos < buf_size - 10;
-           i++) {
-        if (i > 0) {
-          len = snprintf(buf + *pos, buf_size - *pos, ", ");
-          *pos += len;
-        }
-        len = snprintf(buf + *pos, buf_size - *pos,
-                       "%s: ", objects[idx].props[i].key);
-        *pos += len;
-        // Recurse with Auto
-        val_to_string_recursive(objects[idx].props[i].value, buf, buf_size, pos,
-                                depth + 1, 0);
+static int dec_hex4(Decoder *d, uint32_t *out) {
+  if (d->end - d->p < 4)
+    return 0;
+  uint32_t v = 0;
+  for (int i = 0; i < 4; i++) {
+    char c = *d->p++;
+    v <<= 4;
+    if (c >= '0' && c <= '9')
+      v |= c - '0';
+    else if (c >= 'a' && c <= 'f')
+      v |= c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+      v |= c - 'A' + 10;
+    else
+      return 0;
+  }
+  *out = v;
+  return 1;
+}
+
+// Parse a string body (d->p just past the opening quote). Sets *chars and
+// *length to the unescaped text: the input itself when it has no escapes,
+// else dec_buf.
+static int dec_string_chars(Decoder *d, const char **chars, size_t *length) {
+  const char *start = d->p;
+  while (d->p < d->end && *d->p != '"' && *d->p != '\\') {
+    if ((unsigned char)*d->p < 0x20)
+      return 0;
+    d->p++;
+  }
+  if (d->p >= d->end)
+    return 0;
+  if (*d->p == '"') {
+    *chars = start;
+    *length = d->p++ - start;
+    return 1;
+  }
+
+  // Escapes: copy into dec_buf, which needs at most the input's length
+  size_t need = (size_t)(d->end - start) + 1;
+  if (need > dec_buf_cap) {
+    char *grown = realloc(dec_buf, need);
+    if (!grown)
+      return 0;
+    dec_buf = grown;
+    dec_buf_cap = need;
+  }
+  size_t n = d->p - start;
+  memcpy(dec_buf, start, n);
+  while (d->p < d->end && *d->p != '"') {
+    unsigned char c = (unsigned char)*d->p++;
+    if (c < 0x20)
+      return 0;
+    if (c != '\\') {
+      dec_buf[n++] = (char)c;
+      continue;
+    }
+    if (d->p >= d->end)
+      return 0;
+    char e = *d->p++;
+    switch (e) {
+    case '"':
+    case '\\':
+    case '/':
+      dec_buf[n++] = e;
+      break;
+    case 'b':
+      dec_buf[n++] = '\b';
+      break;
+    case 'f':
+      dec_buf[n++] = '\f';
+      break;
+    case 'n':
+      dec_buf[n++] = '\n';
+      break;
+    case 'r':
+      dec_buf[n++] = '\r';
+      break;
+    case 't':
+      dec_buf[n++] = '\t';
+      break;
+    case 'u': {
+      uint32_t cp;
+      if (!dec_hex4(d, &cp))
+        return 0;
+      // A surrogate pair is 12 input bytes for a 4-byte char
+      if (cp >= 0xD800 && cp <= 0xDBFF && d->end - d->p >= 6 &&
+          d->p[0] == '\\' && d->p[1] == 'u') {
+        const char *save = d->p;
+        uint32_t lo;
+        d->p += 2;
+        if (dec_hex4(d, &lo) && lo >= 0xDC00 && lo <= 0xDFFF)
+          cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+        else
+          d->p = save;
       }
-      len = snprintf(buf + *pos, buf_size - *pos, "}");
-      *pos += len;
-      return;
+      // 6 input bytes always cover the UTF-8 form
+      if (cp < 0x80) {
+        dec_buf[n++] = (char)cp;
+      } else if (cp < 0x800) {
+        dec_buf[n++] = (char)(0xC0 | cp >> 6);
+        dec_buf[n++] = (char)(0x80 | (cp & 0x3F));
+      } else if (cp < 0x10000) {
+        dec_buf[n++] = (char)(0xE0 | cp >> 12);
+        dec_buf[n++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        dec_buf[n++] = (char)(0x80 | (cp & 0x3F));
+      } else {
+        dec_buf[n++] = (char)(0xF0 | cp >> 18);
+        dec_buf[n++] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        dec_buf[n++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        dec_buf[n++] = (char)(0x80 | (cp & 0x3F));
+      }
+      break;
     }
+    default:
+      return 0;
+    }
+  }
+  if (d->p >= d->end)
+    return 0;
+  d->p++;
+  *chars = dec_buf;
+  *length = n;
+  return 1;
+}
+
+static Value dec_number(Decoder *d) {
+  const char *start = d->p;
+  int negative = 0;
+  if (*d->p == '-') {
+    negative = 1;
+    d->p++;
   }
+  if (d->p >= d->end || *d->p < '0' || *d->p > '9')
+    return dec_fail(d);
+  unsigned long n = 0;
+  while (d->p < d->end && *d->p >= '0' && *d->p <= '9')
+    n = n * 10 + (unsigned long)(*d->p++ - '0');
+  if (d->p < d->end && (*d->p == '.' || *d->p == 'e' || *d->p == 'E')) {
+    // Rare in our data: let strtod read the whole number, then truncate
+    char *stop;
+    double v = strtod(start, &stop);
+    if (stop <= d->p || stop > d->end)
+      return dec_fail(d);
+    d->p = stop;
+    return VAL_INT((long)v);
+  }
+  return VAL_INT(negative ? -(long)n : (long)n);
+}
 
-  // Try List
-  if ((force_type == 2) || (is_auto && list_idx != -1)) {
-    long idx = (force_type == 2) ? id : list_idx;
-    // Unwrap
-    if ((idx & TYPE_MASK_LIST) == TYPE_MASK_LIST)
-      idx &= ~TYPE_MASK_LIST;
+static int dec_literal(Decoder *d, const char *word, size_t length) {
+  if ((size_t)(d->end - d->p) < length || memcmp(d->p, word, length) != 0)
+    return 0;
+  d->p += length;
+  return 1;
+}
 
-    if (idx > 0 && idx < MAX_LISTS && lists[idx].in_use) {
-      snprintf(buf + *pos, buf_size - *pos, "[");
-      *pos += strlen(buf + *pos);
+static Value dec_value(Decoder *d, int depth) {
+  dec_skip_space(d);
+  if (d->p >= d->end || depth > JSON_MAX_DEPTH)
+    return dec_fail(d);
 
-      for (int i = 0; i < lists[idx].count && *pos < buf_size - 10; i++) {
-        if (i > 0) {
-          snprintf(buf + *pos, buf_size - *pos, ", ");
-          *pos += strlen(buf + *pos);
-        }
-        val_to_string_recursive(lists[idx].items[i], buf, buf_size, pos,
-                                depth + 1, 0);
+  char c = *d->p;
+  if (c == '"') {
+    d->p++;
+    const char *chars;
+    size_t length;
+    if (!dec_string_chars(d, &chars, &length))
+      return dec_fail(d);
+    return str_from(chars, length);
+  }
+  if (c == '[') {
+    d->p++;
+    Value list = ds_list_create();
+    dec_skip_space(d);
+    if (d->p < d->end && *d->p == ']') {
+      d->p++;
+      return list;
+    }
+    for (;;) {
+      Value item = dec_value(d, depth + 1);
+      if (d->failed)
+        return VAL_INT(0);
+      ds_list_push(list, item);
+      dec_skip_space(d);
+      if (d->p < d->end && *d->p == ',') {
+        d->p++;
+      } else if (d->p < d->end && *d->p == ']') {
+        d->p++;
+        return list;
+      } else {
+        return dec_fail(d);
       }
-      snprintf(buf + *pos, buf_size - *pos, "]");
-      *pos += strlen(buf + *pos);
-      return;
     }
   }
-
-  // Plain Integer
-  int len = snprintf(buf + *pos, buf_size - *pos, "%ld", id);
-  *pos += len;
+  if (c == '{') {
+    d->p++;
+    Value map = ds_map_create();
+    dec_skip_space(d);
+    if (d->p < d->end && *d->p == '}') {
+      d->p++;
+      return map;
+    }
+    for (;;) {
+      dec_skip_space(d);
+      const char *chars;
+      size_t length;
+      if (d->p >= d->end || *d->p++ != '"' ||
+          !dec_string_chars(d, &chars, &length))
+        return dec_fail(d);
+      // Copied now, as the value's strings reuse dec_buf
+      Value key = str_from(chars, length);
+      dec_skip_space(d);
+      if (d->p >= d->end || *d->p++ != ':')
+        return dec_fail(d);
+      Value value = dec_value(d, depth + 1);
+      if (d->failed)
+        return VAL_INT(0);
+      ds_map_set(map, key, value);
+      dec_skip_space(d);
+      if (d->p < d->end && *d->p == ',') {
+        d->p++;
+      } else if (d->p < d->end && *d->p == '}') {
+        d->p++;
+        return map;
+      } else {
+        return dec_fail(d);
+      }
+    }
+  }
+  if (c == '-' || (c >= '0' && c <= '9'))
+    return dec_number(d);
+  if (dec_literal(d, "true", 4))
+    return VAL_INT(1);
+  if (dec_literal(d, "false", 5) || dec_literal(d, "null", 4))
+    return VAL_INT(0);
+  return dec_fail(d);
 }
 
-// Public: List to String
-Value ds_list_to_string(Value list_val) {
-  static char buffer[4096];
-  int pos = 0;
-  // Force type 2 (List)
-  val_to_string_recursive(list_val, buffer, sizeof(buffer), &pos, 0, 2);
-
-  char *result = (char *)gc_alloc(pos + 1, GC_TYPE_STRING);
-  if (result) {
-    memcpy(result, buffer, pos + 1);
-    return VAL_OBJ(result);
-  }
-  return VAL_OBJ(buffer);
+Value ds_json_decode(Value json_val) {
+  long length = str_length(json_val);
+  if (length == 0)
+    return VAL_INT(0);
+  const char *json = (const char *)AS_OBJ(json_val);
+  Decoder d = {json, json + length, 0};
+  Value result = dec_value(&d, 0);
+  dec_skip_space(&d);
+  if (d.failed || d.p != d.end)
+    return VAL_INT(0);
+  return result;
 }
 
-// Public: Object to String
-Value ds_object_to_string(Value obj_val) {
-  static char buffer[4096];
-  int pos = 0;
-  // Force type 1 (Object)
-  val_to_string_recursive(obj_val, buffer, sizeof(buffer), &pos, 0, 1);
+// ============================================================================
+// String Builder
+// A builder is a list of pieces: strings as appended, and tagged ints for
+// single chars so append_char allocates nothing. finish() sizes the result
+// once and copies every piece in, instead of the O(n^2) concat chain.
+// ============================================================================
 
-  char *result = (char *)gc_alloc(pos + 1, GC_TYPE_STRING);
-  if (result) {
-    memcpy(result, buffer, pos + 1);
-    return VAL_OBJ(result);
-  }
-  return VAL_OBJ(buffer);
-}
+Value ds_builder_create(void) { return ds_list_create(); }
 
-// Public: Auto to String
-Value ds_val_to_string(Value val) {
-  static char buffer[4096];
-  int pos = 0;
-  // Force type 0 (Auto)
-  val_to_string_recursive(val, buffer, sizeof(buffer), &pos, 0, 0);
+// The append functions return the builder so calls can be chained
+Value ds_builder_append(Value builder_val, Value str_val) {
+  if (str_length(str_val))
+    ds_list_push(builder_val, str_val);
+  return builder_val;
+}
 
-  char *result = (char *)gc_alloc(pos + 1, GC_TYPE_STRING);
-  if (result) {
-    memcpy(result, buffer, pos + 1);
-    return VAL_OBJ(result);
-  }
-  return VAL_OBJ(buffer);
+Value ds_builder_append_int(Value builder_val, Value int_val) {
+  ds_list_push(builder_val, ds_int_to_string(int_val));
+  return builder_val;
 }
 
-// Public: JSON Encode (Smart Auto - Try Object, Try List)
-Value ds_json_encode(Value val) {
-  static char buffer[4096];
-  int pos = 0;
-  // Force type 3 (Smart Auto)
-  val_to_string_recursive(val, buffer, sizeof(buffer), &pos, 0, 3);
+Value ds_builder_append_char(Value builder_val, Value char_code_val) {
+  char c = (char)AS_INT(char_code_val);
+  if (c)
+    ds_list_push(builder_val, VAL_INT((unsigned char)c));
+  return builder_val;
+}
 
-  char *result = (char *)gc_alloc(pos + 1, GC_TYPE_STRING);
-  if (result) {
-    memcpy(result, buffer, pos + 1);
-    return VAL_OBJ(result);
+// Join the pieces into one string and empty the builder for reuse
+Value ds_builder_finish(Value builder_val) {
+  List *l = list_of(builder_val);
+  if (!l)
+    return STR_LIT("");
+  size_t length = 0;
+  for (int i = 0; i < l->count; i++) {
+    Value piece = list_items(l)[i];
+    length += IS_INT(piece) ? 1 : (size_t)str_length(piece);
+  }
+  char *result = str_alloc(length);
+  if (!result)
+    return STR_LIT("");
+  char *out = result;
+  Value *items = list_items(l);
+  for (int i = 0; i < l->count; i++) {
+    Value piece = items[i];
+    if (IS_INT(piece)) {
+      *out++ = (char)AS_INT(piece);
+    } else {
+      long n = str_length(piece);
+      memcpy(out, AS_OBJ(piece), n);
+      out += n;
+    }
   }
-  return VAL_OBJ(buffer);
+  l->count = 0;
+  return VAL_OBJ(result);
 }
 
 // ============================================================================
@@ -1264,25 +3333,41 @@ typedef struct {
   float *data;
   int count;
   int in_use;
+  int next_free; // Free-list link while !in_use
 } FloatBuffer;
 
+// Float buffers are freed explicitly (buf_free), not swept, so their free
+// list is only ever pushed there
 static FloatBuffer float_buffers[MAX_FLOAT_BUFFERS];
+static int float_buffer_free_head = 0;
+static int float_buffers_initialized = 0;
 
 Value buf_create_floats(Value count) {
   long c = AS_INT(count);
   if (c <= 0 || c > MAX_BUFFER_SIZE)
     return VAL_INT(0);
 
-  for (int i = 1; i < MAX_FLOAT_BUFFERS; i++) {
-    if (!float_buffers[i].in_use) {
-      float_buffers[i].in_use = 1;
-      float_buffers[i].count = c;
-      float_buffers[i].data =
-          (float *)gc_alloc(c * sizeof(float), GC_TYPE_FLOAT_BUFFER);
-      return VAL_INT(i);
+  if (!float_buffers_initialized) {
+    for (int i = MAX_FLOAT_BUFFERS - 1; i > 0; i--) {
+      float_buffers[i].next_free = float_buffer_free_head;
+      float_buffer_free_head = i;
     }
+    float_buffers_initialized = 1;
   }
-  return VAL_INT(0);
+  int i = float_buffer_free_head;
+  if (i == 0) {
+    gc_alloc_failed("float buffers");
+    return VAL_INT(0);
+  }
+  float_buffer_free_head = float_buffers[i].next_free;
+  gc_stats.float_buffers++;
+  gc_stats.allocations++;
+
+  float_buffers[i].in_use = 1;
+  float_buffers[i].count = c;
+  float_buffers[i].data =
+      (float *)gc_alloc(c * sizeof(float), GC_TYPE_FLOAT_BUFFER);
+  return VAL_INT(i);
 }
 
 void buf_set_float(Value buffer, Value index, float value) {
@@ -1299,6 +3384,14 @@ void buf_set_float(Value buffer, Value index, float value) {
 }
 
 void buf_upload(Value target, Value buffer_handle, Value usage) {
+  if (IS_ARRAY(buffer_handle)) {
+    ArrayHeader *h = ARRAY_HEADER(buffer_handle);
+    ensure_gl_context();
+    glBufferData((GLenum)AS_INT(target),
+                 (GLsizeiptr)h->count * array_elem_size[array_kind(h)], h + 1,
+                 (GLenum)AS_INT(usage));
+    return;
+  }
   long buf = AS_INT(buffer_handle);
   if (buf <= 0 || buf >= MAX_FLOAT_BUFFERS)
     return;
@@ -1317,136 +3410,605 @@ void buf_free(Value buffer_handle) {
   if (!float_buffers[buf].in_use)
     return;
 
-  // Unregister from GC and free
-  gc_unregister(float_buffers[buf].data);
-  free(float_buffers[buf].data);
+  gc_free(float_buffers[buf].data);
   float_buffers[buf].in_use = 0;
+  gc_stats.float_buffers--;
+  float_buffers[buf].next_free = float_buffer_free_head;
+  float_buffer_free_head = buf;
 }
 
 // ============================================================================
 // GC Mark and Sweep Implementation
 // (Defined here after all data structures are declared)
+//
+// Tri-color and incremental: white = mark != gc_epoch, grey = marked and on
+// the gc_grey worklist, black = marked and scanned. A cycle shades the roots,
+// drains the worklist, then sweeps the heap and the object/list tables, all in
+// slices handed out by on_frame_start. The mutator runs between slices, so
+// while marking every store into a global, object, list or the exec stack
+// shades the stored value (an insertion barrier: GC_WB / gc_write_barrier),
+// and a black container never ends up pointing at a white one. Slices only
+// ever run from on_frame_start, when no C locals hold heap references.
 // ============================================================================
 
-// Recursive marker: handles both pointers (strings) and integer handles
-// (Objects/Lists) This is "Conservative GC" effectively, as we treat any
-// integer that *looks* like a handle as one.
-static void gc_mark_value(Value val) {
-  if (IS_OBJ(val)) {
-    // Pointer type (String)
-    gc_mark_ptr((void *)AS_OBJ(val));
-  } else {
-    // Integer type - could be a Masked Object handle or Masked List handle
-    long id = AS_INT(val);
+#define GC_STEP_WORK 1024 // Work units (values scanned, cells swept) per slice
+#define GC_ROOT_SLICE 512 // Root array elements scanned per slice
+
+static Value *gc_grey = NULL;
+static int gc_grey_count = 0;
+static int gc_grey_capacity = 0;
+static int gc_grey_overflow = 0; // Worklist couldn't grow: abandon the cycle
+
+static int gc_root_array_cursor = 0; // Root array scan position
+static int gc_root_elem_cursor = 0;
+static int gc_sweep_object = 0; // Table sweep positions (walking down)
+static int gc_sweep_list = 0;
+
+static void gc_grey_push(Value val) {
+  if (gc_grey_count == gc_grey_capacity) {
+    int capacity = gc_grey_capacity ? gc_grey_capacity * 2 : 1024;
+    Value *grown = realloc(gc_grey, capacity * sizeof(Value));
+    if (!grown) {
+      gc_grey_overflow = 1;
+      return;
+    }
+    gc_grey = grown;
+    gc_grey_capacity = capacity;
+  }
+  gc_grey[gc_grey_count++] = val;
+}
+
+// Grey values pass through a small FIFO on their way from the stack to
+// gc_scan. Their table slots are prefetched on entry, so each has had a few
+// scans' worth of time to arrive in cache by the time it is scanned.
+#define GC_PREFETCH_DEPTH 8
+
+static Value gc_prefetch_fifo[GC_PREFETCH_DEPTH];
+static int gc_prefetch_head = 0;
+static int gc_prefetch_count = 0;
 
-    // Check for Object Mask
+static inline void gc_prefetch_grey(Value val) {
+  long id = AS_INT(val);
+  char *slot = (id & TYPE_MASK_OBJ) == TYPE_MASK_OBJ
+                   ? (char *)&objects[id & ~TYPE_MASK_OBJ]
+                   : (char *)&lists[id & ~TYPE_MASK_LIST];
+  __builtin_prefetch(slot);
+  __builtin_prefetch(slot + 64);
+}
+
+// Next grey value to scan; 0 once the worklist is empty
+static inline int gc_grey_next(Value *val) {
+  while (gc_prefetch_count < GC_PREFETCH_DEPTH && gc_grey_count > 0) {
+    Value next = gc_grey[--gc_grey_count];
+    gc_prefetch_grey(next);
+    gc_prefetch_fifo[(gc_prefetch_head + gc_prefetch_count++) %
+                     GC_PREFETCH_DEPTH] = next;
+  }
+  if (gc_prefetch_count == 0)
+    return 0;
+  *val = gc_prefetch_fifo[gc_prefetch_head];
+  gc_prefetch_head = (gc_prefetch_head + 1) % GC_PREFETCH_DEPTH;
+  gc_prefetch_count--;
+  if (gc_prefetch_count > 0) {
+    // The slot of the next one is in cache by now: fetch its property array
+    // (or items, or map table), which for spilled objects lives elsewhere
+    long id = AS_INT(gc_prefetch_fifo[gc_prefetch_head]);
     if ((id & TYPE_MASK_OBJ) == TYPE_MASK_OBJ) {
-      long idx = id & ~TYPE_MASK_OBJ;
-      if (idx > 0 && idx < MAX_OBJECTS && objects[idx].in_use &&
-          !objects[idx].marked) {
-        objects[idx].marked = 1;
-        // Recurse
-        for (int i = 0; i < objects[idx].prop_count; i++) {
-          gc_mark_value(objects[idx].props[i].value);
-          if (objects[idx].props[i].key) {
-            gc_mark_ptr(objects[idx].props[i].key);
-          }
-        }
-      }
+      Object *o = &objects[id & ~TYPE_MASK_OBJ];
+      __builtin_prefetch(o->map ? (void *)o->map : (void *)object_props(o));
+    } else
+      __builtin_prefetch(list_items(&lists[id & ~TYPE_MASK_LIST]));
+  }
+  return 1;
+}
+
+// Shade a value: mark it and queue objects/lists for scanning (strings have
+// no children, so marking is enough). This is "Conservative GC" effectively,
+// as we treat any integer that *looks* like a handle as one.
+static inline void gc_shade_value(Value val) {
+  if (IS_OBJ(val)) {
+    // Pointer type (String): its block starts at the header
+    if (val)
+      gc_mark_ptr(STR_HEADER(val));
+    return;
+  }
+  long id = AS_INT(val);
+  if ((id & TYPE_MASK_OBJ) == TYPE_MASK_OBJ) {
+    long idx = id & ~TYPE_MASK_OBJ;
+    if (idx > 0 && idx < object_table_size && objects[idx].in_use &&
+        objects[idx].marked != gc_epoch) {
+      objects[idx].marked = gc_epoch;
+      gc_grey_push(val);
     }
-    // Check for List Mask
-    else if ((id & TYPE_MASK_LIST) == TYPE_MASK_LIST) {
-      long idx = id & ~TYPE_MASK_LIST;
-      if (idx > 0 && idx < MAX_LISTS && lists[idx].in_use &&
-          !lists[idx].marked) {
-        lists[idx].marked = 1;
-        if (lists[idx].items)
-          gc_mark_ptr(lists[idx].items);
-        for (int i = 0; i < lists[idx].count; i++) {
-          gc_mark_value(lists[idx].items[i]);
-        }
-      }
+  } else if ((id & TYPE_MASK_LIST) == TYPE_MASK_LIST) {
+    long idx = id & ~TYPE_MASK_LIST;
+    if (idx > 0 && idx < list_table_size && lists[idx].in_use &&
+        lists[idx].marked != gc_epoch) {
+      lists[idx].marked = gc_epoch;
+      gc_grey_push(val);
     }
-    // Else Plain Integer - Do Nothing
   }
+  // Else Plain Integer - Do Nothing
 }
 
-static void gc_mark(void) {
-  // Mark collected roots
+void gc_shade(Value val) { gc_shade_value(val); }
 
-  // 1. Registered root arrays (globals)
-  for (int i = 0; i < GC_MAX_ROOT_ARRAYS; i++) {
-    if (gc_root_arrays[i].in_use) {
-      for (int j = 0; j < gc_root_arrays[i].size; j++) {
-        gc_mark_value(gc_root_arrays[i].array[j]);
+// Blacken a grey object or list by shading what it holds; returns work done
+static long gc_scan(Value val) {
+  long id = AS_INT(val);
+  if ((id & TYPE_MASK_OBJ) == TYPE_MASK_OBJ) {
+    Object *o = &objects[id & ~TYPE_MASK_OBJ];
+    if (o->map) {
+      gc_mark_ptr(o->map);
+      MapEntry *entries = o->map->entries;
+      for (int i = 0; i < o->map->capacity; i++) {
+        if (MAP_LIVE(entries[i].key)) {
+          gc_shade_value(entries[i].key);
+          gc_shade_value(entries[i].value);
+        }
       }
+      return o->map->capacity + 1;
     }
+    Property *props = object_props(o);
+    for (int i = 0; i < o->prop_count; i++) {
+      gc_shade_value(props[i].value);
+    }
+    return o->prop_count + 1;
+  }
+  List *l = &lists[id & ~TYPE_MASK_LIST];
+  if (l->spill)
+    gc_mark_ptr(l->spill);
+  Value *items = list_items(l);
+  for (int i = 0; i < l->count; i++) {
+    gc_shade_value(items[i]);
   }
+  return l->count + 1;
+}
 
-  // 2. Registered root values (single globals)
+// Shade the small root sets: single globals, float buffer data and the exec
+// stack. Done when marking starts and again when it ends, which also covers
+// any store to them the barrier didn't see.
+static void gc_shade_small_roots(void) {
   for (int i = 0; i < gc_root_value_count; i++) {
-    if (gc_root_values[i]) {
-      Value val = *gc_root_values[i];
-      long id = AS_INT(val);
-      gc_mark_value(val);
-    }
+    if (gc_root_values[i])
+      gc_shade_value(*gc_root_values[i]);
   }
-
-  // 3. Mark float buffer data
   for (int i = 0; i < MAX_FLOAT_BUFFERS; i++) {
-    if (float_buffers[i].in_use) {
+    if (float_buffers[i].in_use)
       gc_mark_ptr(float_buffers[i].data);
+  }
+  for (int i = 0; i < gc_exec_stack_depth; i++) {
+    gc_shade_value(gc_exec_stack[i]);
+  }
+  for (GcFrame *frame = gc_frame_top; frame; frame = frame->prev) {
+    for (int i = 0; i < frame->count; i++) {
+      gc_shade_value(*frame->slots[i]);
     }
   }
+}
 
-  // 4. Mark execution stack (temporary environments during function calls)
-  for (int i = 0; i < gc_exec_stack_depth; i++) {
-    gc_mark_value(gc_exec_stack[i]);
+// Shade the next slice of the registered root arrays; 0 once all are done
+static int gc_mark_roots_step(long *budget) {
+  for (; gc_root_array_cursor < GC_MAX_ROOT_ARRAYS; gc_root_array_cursor++) {
+    GcRootArray *root = &gc_root_arrays[gc_root_array_cursor];
+    if (!root->in_use || gc_root_elem_cursor >= root->used) {
+      gc_root_elem_cursor = 0;
+      continue;
+    }
+    int end = gc_root_elem_cursor + GC_ROOT_SLICE;
+    if (end > root->used)
+      end = root->used;
+    for (int j = gc_root_elem_cursor; j < end; j++) {
+      gc_shade_value(root->array[j]);
+    }
+    *budget -= end - gc_root_elem_cursor;
+    gc_root_elem_cursor = end;
+    return 1;
   }
+  return 0;
 }
 
-static void gc_sweep(void) {
-  // 1. Sweep Allocations (Strings, Backing Arrays)
-  for (int i = 0; i < GC_MAX_ALLOCATIONS; i++) {
-    if (gc_allocations[i].in_use) {
-      if (!gc_allocations[i].marked) {
-        // Free unmarked allocation
-        gc_hash_remove(gc_allocations[i].ptr); // Remove from hash table
-        free(gc_allocations[i].ptr);
-        gc_allocations[i].ptr = NULL;
-        gc_allocations[i].in_use = 0;
-        gc_allocation_count--;
-      } else {
-        // Clear mark for next cycle
-        gc_allocations[i].marked = 0;
+// A map's table is unmarked too, so whichever sweep is running takes it
+static void gc_free_object(int i) {
+  objects[i].in_use = 0; // Reclaim slot (keys are immortal atoms)
+  object_release_props(&objects[i]);
+  objects[i].map = NULL;
+  objects[i].next_free = object_free_head;
+  object_free_head = i;
+  gc_account_free(sizeof(Object));
+  gc_stats.objects--;
+}
+
+// A spilled items array is unmarked too, so whichever sweep is running takes it
+static void gc_free_list(int i) {
+  lists[i].in_use = 0;
+  lists[i].next_free = list_free_head;
+  list_free_head = i;
+  gc_account_free(sizeof(List));
+  gc_stats.lists--;
+}
+
+// Empty the young logs and remembered set (after a minor, or when a major
+// takes over the whole heap)
+static void gc_reset_nursery(void) {
+  for (int i = 0; i < gc_remembered.count; i++) {
+    long id = AS_INT((Value)gc_remembered.items[i]);
+    if ((id & TYPE_MASK_OBJ) == TYPE_MASK_OBJ)
+      objects[id & ~TYPE_MASK_OBJ].remembered = 0;
+    else
+      lists[id & ~TYPE_MASK_LIST].remembered = 0;
+  }
+  gc_young_cells.count = 0;
+  gc_young_objects.count = 0;
+  gc_young_lists.count = 0;
+  gc_remembered.count = 0;
+  gc_root_slots.count = 0;
+  gc_young_large = 0;
+  gc_nursery_lost = 0;
+  gc_root_slots_lost = 0;
+  gc_nursery_bytes = 0;
+  gc_idle_frames = 0;
+}
+
+// Size the next nursery from how much of this one survived. Survivors cost a
+// minor the same whenever it runs, so when most survive, a bigger nursery
+// means fewer minors for the same work and gives the merely medium-lived
+// time to die; when few do, drift back to the tuned size.
+static void gc_adapt_nursery(size_t allocated, size_t freed) {
+  size_t survived = allocated > freed ? allocated - freed : 0;
+  if (survived * 2 > allocated) {
+    gc_nursery_limit *= 2;
+    if (gc_nursery_limit > GC_NURSERY_MAX)
+      gc_nursery_limit = GC_NURSERY_MAX;
+  } else if (survived * 8 < allocated && gc_nursery_limit > gc_nursery_base) {
+    gc_nursery_limit /= 2;
+    if (gc_nursery_limit < gc_nursery_base)
+      gc_nursery_limit = gc_nursery_base;
+  }
+}
+
+// Minor collection: stop-the-world, but it only traces and frees the nursery.
+// Shading skips anything already carrying gc_epoch, i.e. the old generation.
+static void gc_minor(void) {
+  size_t allocated = gc_nursery_bytes, heap_before = gc_heap_bytes;
+  gc_stats.minors++;
+  gc_shade_small_roots();
+  if (gc_root_slots_lost) {
+    for (int i = 0; i < GC_MAX_ROOT_ARRAYS; i++) {
+      for (int j = 0; gc_root_arrays[i].in_use && j < gc_root_arrays[i].used;
+           j++) {
+        gc_shade_value(gc_root_arrays[i].array[j]);
       }
     }
+  } else {
+    for (int i = 0; i < gc_root_slots.count; i++) {
+      gc_shade_value(*(Value *)gc_root_slots.items[i]);
+    }
+  }
+  for (int i = 0; i < gc_remembered.count; i++) {
+    gc_scan((Value)gc_remembered.items[i]);
+  }
+  for (Value val; gc_grey_next(&val);) {
+    gc_scan(val);
+  }
+  if (gc_grey_overflow) {
+    // The unmarked young just stay put until the next major
+    printf("[GC ERROR] mark worklist exhausted memory; skipping sweep\n");
+    gc_grey_overflow = 0;
+    gc_reset_nursery();
+    return;
   }
 
-  // 2. Sweep Objects
-  for (int i = 1; i < MAX_OBJECTS; i++) {
-    if (objects[i].in_use) {
-      if (!objects[i].marked) {
-        objects[i].in_use = 0; // Reclaim slot
-        // Keys are GC_TYPE_STRING and will be collected by sweep above
-      } else {
-        objects[i].marked = 0;
-      }
+  for (int i = 0; i < gc_young_cells.count; i++) {
+    // Cells freed and reused since are logged again; freed ones are skipped
+    GcHeader *h = (GcHeader *)gc_young_cells.items[i];
+    if (h->type != GC_TYPE_FREE && h->marked != gc_epoch)
+      gc_release(h);
+  }
+  if (gc_young_large > 0) {
+    GcLarge *large = gc_large_list;
+    while (large) {
+      GcLarge *next = large->next;
+      if (large->header.marked != gc_epoch)
+        gc_release(&large->header);
+      large = next;
+    }
+  }
+  for (int i = 0; i < gc_young_objects.count; i++) {
+    int idx = (int)gc_young_objects.items[i];
+    if (objects[idx].in_use && objects[idx].marked != gc_epoch)
+      gc_free_object(idx);
+  }
+  for (int i = 0; i < gc_young_lists.count; i++) {
+    int idx = (int)gc_young_lists.items[i];
+    if (lists[idx].in_use && lists[idx].marked != gc_epoch)
+      gc_free_list(idx);
+  }
+  gc_adapt_nursery(allocated, heap_before - gc_heap_bytes);
+  gc_reset_nursery();
+}
+
+static void gc_begin_cycle(void) {
+  gc_epoch = gc_epoch % 255 + 1; // Last cycle's marks all turn white
+  gc_alloc_mark = gc_epoch;
+  gc_marking = 1;
+  gc_phase = GC_MARK;
+  gc_root_array_cursor = 0;
+  gc_root_elem_cursor = 0;
+  gc_reset_nursery();
+  gc_shade_small_roots();
+  gc_cycle_start_bytes = gc_heap_bytes;
+}
+
+// Set the next major's trigger: the heap may grow by gc_heap_growth percent
+// of what survived, scaled by the survivor ratio from 50% of that (the last
+// cycle freed nearly everything, so come back sooner) to 100% (it freed
+// nothing, so collecting sooner would have been wasted work)
+static void gc_update_trigger(void) {
+  double growth = gc_heap_growth / 100.0 * (0.5 + gc_survivor_ratio / 2);
+  gc_major_trigger =
+      gc_cycle_live_bytes + (size_t)(gc_cycle_live_bytes * growth);
+  if (gc_major_trigger < GC_MIN_HEAP)
+    gc_major_trigger = GC_MIN_HEAP;
+}
+
+static void gc_end_cycle(void) {
+  size_t start = gc_cycle_start_bytes;
+  gc_cycle_live_bytes = gc_heap_bytes;
+  gc_survivor_ratio = gc_cycle_live_bytes < start
+                          ? (double)gc_cycle_live_bytes / start
+                          : 1.0;
+  gc_update_trigger();
+  gc_stats.majors++;
+  gc_phase = GC_IDLE;
+  gc_marking = 0;
+  gc_alloc_mark = 0;
+  gc_grey_count = 0;
+  gc_prefetch_count = 0;
+  gc_grey_overflow = 0;
+}
+
+// Roots and worklist exhausted: re-shade the small roots, drain, and move on
+// to sweeping
+static void gc_finish_mark(void) {
+  gc_shade_small_roots();
+  for (Value val; gc_grey_next(&val);) {
+    gc_scan(val);
+  }
+  if (gc_grey_overflow) {
+    // Something marked was never scanned, so white can't be trusted: keep
+    // everything this time round
+    printf("[GC ERROR] mark worklist exhausted memory; skipping sweep\n");
+    gc_end_cycle();
+    return;
+  }
+  gc_marking = 0;
+  gc_phase = GC_SWEEP;
+  gc_sweep_heap_begin();
+  gc_sweep_object = object_table_size - 1;
+  gc_sweep_list = list_table_size - 1;
+}
+
+// Sweep until the budget is spent; 1 once everything has been swept. Slots
+// are freed walking down so lower indices come off the free lists first;
+// slots added by table growth mid-sweep are fresh and never looked at.
+static int gc_sweep_step(long *budget) {
+  if (!gc_sweep_heap_step(budget))
+    return 0;
+
+  for (; gc_sweep_object > 0; gc_sweep_object--, (*budget)--) {
+    if (*budget <= 0)
+      return 0;
+    if (objects[gc_sweep_object].in_use &&
+        objects[gc_sweep_object].marked != gc_epoch)
+      gc_free_object(gc_sweep_object);
+  }
+
+  for (; gc_sweep_list > 0; gc_sweep_list--, (*budget)--) {
+    if (*budget <= 0)
+      return 0;
+    if (lists[gc_sweep_list].in_use && lists[gc_sweep_list].marked != gc_epoch)
+      gc_free_list(gc_sweep_list);
+  }
+  return 1;
+}
+
+// Do about `budget` units of work on the current cycle
+static void gc_advance(long budget) {
+  while (budget > 0 && gc_phase != GC_IDLE) {
+    if (gc_phase == GC_MARK) {
+      Value val;
+      if (gc_grey_next(&val))
+        budget -= gc_scan(val);
+      else if (!gc_mark_roots_step(&budget))
+        gc_finish_mark();
+    } else if (gc_sweep_step(&budget)) {
+      gc_end_cycle();
     }
   }
+}
 
-  // 3. Sweep Lists
-  for (int i = 1; i < MAX_LISTS; i++) {
-    if (lists[i].in_use) {
-      if (!lists[i].marked) {
-        lists[i].in_use = 0; // Reclaim slot
-        // items array is GC_TYPE_LIST_ITEMS and will be collected by sweep
-        // above
-      } else {
-        lists[i].marked = 0;
-      }
+static int64_t gc_now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Advance the current cycle for up to budget_us (<= 0: run it to the end)
+static void gc_step(long budget_us) {
+  if (budget_us <= 0) {
+    gc_advance(LONG_MAX);
+    return;
+  }
+  int64_t deadline = gc_now_us() + budget_us;
+  do {
+    gc_advance(GC_STEP_WORK);
+  } while (gc_phase != GC_IDLE && gc_now_us() < deadline);
+}
+
+// Run a full GC cycle, finishing any in progress first: the caller wants
+// what is garbage *now* reclaimed
+static void gc_collect(void) {
+  gc_step(0);
+  gc_begin_cycle();
+  gc_step(0);
+}
+
+// A minor is due once the nursery is full, or after GC_IDLE_FRAMES of a
+// program allocating too little to fill it (menus), so its garbage is
+// still returned
+static int gc_nursery_due(void) {
+  if (gc_nursery_bytes >= gc_nursery_limit)
+    return 1;
+  return gc_nursery_bytes > 0 && ++gc_idle_frames >= GC_IDLE_FRAMES;
+}
+
+// Give the major cycle in progress its slice, or run a minor when one is due
+// and start a major if the heap has outgrown its trigger. 0 if there was
+// nothing to do.
+static int gc_frame_slice(void) {
+  if (gc_phase == GC_IDLE) {
+    if (!gc_nursery_lost) {
+      if (!gc_nursery_due())
+        return 0;
+      gc_minor();
+      if (gc_heap_bytes < gc_major_trigger)
+        return 1;
     }
+    gc_begin_cycle();
+  }
+  gc_step(gc_frame_budget_us);
+  return 1;
+}
+
+// Called every frame
+static void gc_maybe_collect(void) {
+  int64_t start = gc_now_us();
+  if (!gc_frame_slice()) {
+    gc_stats.frame_us = 0;
+    return;
   }
+  gc_stats.frame_us = (long)(gc_now_us() - start);
+  gc_record_pause(gc_stats.frame_us);
+}
+
+// Public function to force a GC cycle (called when bot stops)
+void gc_force_collect(void) {
+  int64_t start = gc_now_us();
+  gc_collect();
+  gc_record_pause((long)(gc_now_us() - start));
+}
+
+Value gc_set_frame_budget(Value microseconds) {
+  long previous = gc_frame_budget_us;
+  long us = AS_INT(microseconds);
+  gc_frame_budget_us = us > 0 ? us : 0;
+  return VAL_INT(previous);
+}
+
+Value gc_frame_budget(void) { return VAL_INT(gc_frame_budget_us); }
+
+Value gc_set_heap_growth(Value percent) {
+  long previous = gc_heap_growth;
+  long p = AS_INT(percent);
+  gc_heap_growth = p > 0 ? p : 0;
+  gc_update_trigger();
+  return VAL_INT(previous);
+}
+
+Value gc_set_nursery_size(Value kilobytes) {
+  long previous = (long)(gc_nursery_base / 1024);
+  long kb = AS_INT(kilobytes);
+  if (kb < GC_NURSERY_MIN / 1024)
+    kb = GC_NURSERY_MIN / 1024;
+  if (kb > GC_NURSERY_MAX / 1024)
+    kb = GC_NURSERY_MAX / 1024;
+  gc_nursery_base = (size_t)kb * 1024;
+  gc_nursery_limit = gc_nursery_base;
+  return VAL_INT(previous);
+}
+
+void gc_get_stats(GcStats *out) {
+  *out = gc_stats;
+  out->heap_bytes = (long)gc_heap_bytes;
+  out->string_bytes = (long)gc_type_bytes[GC_TYPE_STRING];
+  out->list_item_bytes = (long)gc_type_bytes[GC_TYPE_LIST_ITEMS];
+  out->float_buffer_bytes = (long)gc_type_bytes[GC_TYPE_FLOAT_BUFFER];
+  out->array_bytes = (long)gc_type_bytes[GC_TYPE_ARRAY];
+  out->map_bytes = (long)gc_type_bytes[GC_TYPE_MAP];
+  // Index 0 of each table is reserved
+  out->object_capacity = object_table_size ? object_table_size - 1 : 0;
+  out->list_capacity = list_table_size ? list_table_size - 1 : 0;
+}
+
+Value gc_stat_majors(void) { return VAL_INT(gc_stats.majors); }
+Value gc_stat_minors(void) { return VAL_INT(gc_stats.minors); }
+
+Value gc_stat_pauses(Value bucket) {
+  long b = AS_INT(bucket);
+  if (b < 0 || b >= GC_PAUSE_BUCKETS)
+    return VAL_INT(0);
+  return VAL_INT(gc_stats.pauses[b]);
+}
+
+Value gc_stat_pause_limit(Value bucket) {
+  long b = AS_INT(bucket);
+  if (b < 0 || b >= GC_PAUSE_BUCKETS - 1)
+    return VAL_INT(0);
+  return VAL_INT(gc_pause_limits_us[b]);
+}
+
+Value gc_stat_pause_last(void) { return VAL_INT(gc_stats.pause_last_us); }
+Value gc_stat_pause_max(void) { return VAL_INT(gc_stats.pause_max_us); }
+Value gc_stat_frame_us(void) { return VAL_INT(gc_stats.frame_us); }
+Value gc_stat_heap_bytes(void) { return VAL_INT((long)gc_heap_bytes); }
+
+Value gc_stat_string_bytes(void) {
+  return VAL_INT((long)gc_type_bytes[GC_TYPE_STRING]);
+}
+
+Value gc_stat_list_item_bytes(void) {
+  return VAL_INT((long)gc_type_bytes[GC_TYPE_LIST_ITEMS]);
+}
+
+Value gc_stat_float_buffer_bytes(void) {
+  return VAL_INT((long)gc_type_bytes[GC_TYPE_FLOAT_BUFFER]);
+}
+
+Value gc_stat_array_bytes(void) {
+  return VAL_INT((long)gc_type_bytes[GC_TYPE_ARRAY]);
+}
+
+Value gc_stat_map_bytes(void) {
+  return VAL_INT((long)gc_type_bytes[GC_TYPE_MAP]);
+}
+
+Value gc_stat_objects(void) { return VAL_INT(gc_stats.objects); }
+
+Value gc_stat_object_capacity(void) {
+  return VAL_INT(object_table_size ? object_table_size - 1 : 0);
+}
+
+Value gc_stat_lists(void) { return VAL_INT(gc_stats.lists); }
+
+Value gc_stat_list_capacity(void) {
+  return VAL_INT(list_table_size ? list_table_size - 1 : 0);
+}
+
+Value gc_stat_float_buffers(void) { return VAL_INT(gc_stats.float_buffers); }
+Value gc_stat_alloc_failures(void) { return VAL_INT(gc_stats.alloc_failures); }
+Value gc_stat_allocations(void) { return VAL_INT(gc_stats.allocations); }
+
+// Zero the counters; the current figures stay
+void gc_stat_reset(void) {
+  memset(gc_stats.pauses, 0, sizeof(gc_stats.pauses));
+  gc_stats.majors = 0;
+  gc_stats.minors = 0;
+  gc_stats.pause_last_us = 0;
+  gc_stats.pause_max_us = 0;
+  gc_stats.pause_total_us = 0;
+  gc_stats.alloc_failures = 0;
+  gc_stats.allocations = 0;
 }
 
 // ============================================================================
@@ -1620,7 +4182,7 @@ Value clipboard_paste_requested(void) {
 #endif
 }
 
-static char clipboard_buffer[16384];
+STR_BUFFER(clipboard_buffer, 16384);
 
 Value clipboard_get_text(void) {
 #ifdef __EMSCRIPTEN__
@@ -1633,11 +4195,11 @@ Value clipboard_get_text(void) {
         }
         HEAP8[ptr + Math.min(text.length, 16383)] = 0;
       },
-      clipboard_buffer);
-  return VAL_OBJ(clipboard_buffer);
+      clipboard_buffer.chars);
+  return str_buffer_value(&clipboard_buffer.header);
 #else
-  clipboard_buffer[0] = 0;
-  return VAL_OBJ(clipboard_buffer);
+  clipboard_buffer.chars[0] = 0;
+  return str_buffer_value(&clipboard_buffer.header);
 #endif
 }
 
@@ -2197,28 +4759,26 @@ void js_call_save_game(Value slot_val, Value code_val, Value upgrades_val,
 #endif
 }
 
-static char load_buffer[65536];
+STR_BUFFER(load_buffer, 65536);
 
+// The slot's raw save JSON (any size) as a heap string, or 0 if it's empty
 Value js_call_load_game(Value slot_val) {
   int slot = (int)AS_INT(slot_val);
 #ifdef __EMSCRIPTEN__
-  int result = EM_ASM_INT(
+  int length = EM_ASM_INT(
       {
         var data = window.loadGameData ? window.loadGameData($0) : null;
-        if (!data)
-          return 0;
-        var ptr = $1;
-        for (var i = 0; i < data.length && i < 65535; i++) {
-          HEAP8[ptr + i] = data.charCodeAt(i);
-        }
-        HEAP8[ptr + Math.min(data.length, 65535)] = 0;
-        return 1;
+        return data ? lengthBytesUTF8(data) : -1;
       },
-      slot, load_buffer);
-
-  if (result == 0)
+      slot);
+  if (length < 0)
     return VAL_INT(0);
-  return VAL_OBJ(load_buffer);
+  char *chars = str_alloc(length);
+  if (!chars)
+    return VAL_INT(0);
+  EM_ASM_({ stringToUTF8(window.loadGameData($0), $1, $2); }, slot, chars,
+          length + 1);
+  return VAL_OBJ(chars);
 #else
   (void)slot;
   return VAL_INT(0);
@@ -2272,90 +4832,6 @@ void js_call_set_setting(Value key_val, Value value_val) {
 #endif
 }
 
-// ============================================================================
-// JSON Parsing Helpers (for Save Data)
-// ============================================================================
-
-static char json_code_buffer[65536];
-static char json_upgrades_buffer[1024];
-
-Value js_parse_save_code(Value json_val) {
-  const char *json = (const char *)AS_OBJ(json_val);
-#ifdef __EMSCRIPTEN__
-  EM_ASM_(
-      {
-        try {
-          var obj = JSON.parse(UTF8ToString($0));
-          var code = obj.code || "";
-          var ptr = $1;
-          for (var i = 0; i < code.length && i < 65535; i++) {
-    HEAP8[ptr + i] = code.charCodeAt(i);
-          }
-          HEAP8[ptr + Math.min(code.length, 65535)] = 0;
-}
-catch(e) { HEAP8[$1] = 0; }
-},
-      json, json_code_buffer);
-return VAL_OBJ(json_code_buffer);
-#else
-  (void)json;
-  json_code_buffer[0] = 0;
-  return VAL_OBJ(json_code_buffer);
-#endif
-}
-
-Value js_parse_save_upgrades(Value json_val) {
-  const char *json = (const char *)AS_OBJ(json_val);
-#ifdef __EMSCRIPTEN__
-  EM_ASM_(
-      {
-        try {
-          var obj = JSON.parse(UTF8ToString($0));
-          var upgrades = obj.upgrades || "";
-          var ptr = $1;
-          for (var i = 0; i < upgrades.length && i < 1023; i++) {
-    HEAP8[ptr + i] = upgrades.charCodeAt(i);
-          }
-          HEAP8[ptr + Math.min(upgrades.length, 1023)] = 0;
-}
-catch(e) { HEAP8[$1] = 0; }
-},
-      json, json_upgrades_buffer);
-return VAL_OBJ(json_upgrades_buffer);
-#else
-  (void)json;
-  json_upgrades_buffer[0] = 0;
-  return VAL_OBJ(json_upgrades_buffer);
-#endif
-}
-
-static char json_chat_state_buffer[65536];
-
-Value js_parse_save_chat_state(Value json_val) {
-  const char *json = (const char *)AS_OBJ(json_val);
-#ifdef __EMSCRIPTEN__
-  EM_ASM_(
-      {
-        try {
-          var obj = JSON.parse(UTF8ToString($0));
-          var chat = obj.chat_state || "";
-          var ptr = $1;
-          for (var i = 0; i < chat.length && i < 65535; i++) {
-    HEAP8[ptr + i] = chat.charCodeAt(i);
-          }
-          HEAP8[ptr + Math.min(chat.length, 65535)] = 0;
-}
-catch(e) { HEAP8[$1] = 0; }
-},
-      json, json_chat_state_buffer);
-return VAL_OBJ(json_chat_state_buffer);
-#else
-  (void)json;
-  json_chat_state_buffer[0] = 0;
-  return VAL_OBJ(json_chat_state_buffer);
-#endif
-}
-
 // Menu Art Fetching
 Value js_get_menu_art_count(void) {
 #ifdef __EMSCRIPTEN__
@@ -2382,10 +4858,10 @@ Value js_get_menu_art_line(Value idx_val) {
         HEAP8[ptr + Math.min(line.length, 65535)] = 0;
         return line.length;
       },
-      idx, load_buffer);
+      idx, load_buffer.chars);
 
-  return VAL_OBJ(load_buffer);
+  return str_buffer_value(&load_buffer.header);
 #else
-  return VAL_OBJ("");
+  return STR_LIT("");
 #endif
 }
@@ -1,6 +1,7 @@
 #ifndef RUNTIME_H
 #define RUNTIME_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 // Basic types
@@ -16,14 +17,82 @@ typedef long Value;
   ((void *)(x)) // Don't modify pointer - WASM strings may be at odd addresses
 #define IS_INT(x) (((x) & 1))
 #define IS_OBJ(x) (!((x) & 1))
+// What a match on int patterns switches on: an int's value, or one no int
+// has, as nothing else is equal to an int
+#define MATCH_INT(x) (IS_INT(x) ? AS_INT(x) : (-__LONG_MAX__ - 1))
+
+// Type Masks for Handles (Distinguish Integers from Handles)
+// 0x10000000 = Object Handle (Bit 28)
+// 0x20000000 = List Handle (Bit 29)
+// These bits are safe in signed 32-bit positive integers even after << 1
+// tagging
+#define TYPE_MASK_OBJ 0x10000000
+#define TYPE_MASK_LIST 0x20000000
+
+// Strings. A string value points at NUL-terminated chars, so C code can read
+// it as a C string, preceded by a StrHeader caching its length and hash. The
+// compiler emits literals with the header filled in (NH_STR_DEF); runtime
+// strings are GC blocks laid out the same way. Every string value needs the
+// header: C code makes literals with STR_LIT, not VAL_OBJ("...").
+typedef struct {
+  uint32_t length;
+  uint32_t hash; // FNV-1a in the low 31 bits, never 0 once computed (0 = not
+                 // yet); STR_INTERNED is set on the canonical interned copy
+} StrHeader;
+
+#define STR_HASH_MASK 0x7fffffffu
+#define STR_INTERNED 0x80000000u
+
+// A length from here up is a typed array's tag (see Typed Arrays below)
+#define ARRAY_TAG 0xfffffff0u
+
+#define STR_HEADER(s) ((StrHeader *)(s) - 1)
+
+// A literal with static storage. Aligned so the chars land on an even
+// address, which is what tells a string from an int.
+#define NH_STR_DEF(name, length, hash, lit)                                    \
+  static struct {                                                              \
+    StrHeader header;                                                          \
+    char chars[(length) + 1];                                                  \
+  } __attribute__((aligned(8))) name = {{(length), (hash)}, lit}
+#define NH_STR(name) VAL_OBJ((name).chars)
+#define STR_LIT(lit)                                                           \
+  ({                                                                           \
+    NH_STR_DEF(__str_lit, sizeof(lit) - 1, 0, lit);                            \
+    NH_STR(__str_lit);                                                         \
+  })
+
+// Length of a string value (0 for 0, an int or a typed array)
+static inline long str_length(Value s) {
+  if (!s || !IS_OBJ(s))
+    return 0;
+  uint32_t length = STR_HEADER(s)->length;
+  return length < ARRAY_TAG ? (long)length : 0;
+}
+uint32_t str_hash(Value s);
+
+// Interning. Each distinct content has one immortal canonical copy, so equal
+// interned strings are the same pointer and val_eq/ds_streq decide two of
+// them without reading chars. ds_intern_literal makes a static literal the
+// canonical copy when there is none yet (the compiler does this at startup).
+Value ds_intern(Value str);
+Value ds_intern_literal(Value lit);
+
+// A heap string copied from a C string (for C code handed text from outside)
+Value str_from_c(const char *chars);
 
 // ============================================================================
 // Garbage Collection - Root Registration
 // ============================================================================
 
 // Register an array as a GC root (call at init for all global arrays that may
-// hold strings)
-void gc_register_root_array(Value *array, int size);
+// hold strings). Returns the id GC_WB_ROOT takes, or -1 if the registry is
+// full. Only the prefix up to the array's high-water mark is scanned: the
+// barriers below raise it, and gc_clear_array resets it.
+int gc_register_root_array(Value *array, int size);
+
+// High-water mark of a registered root array (0 if it isn't one)
+Value gc_root_array_used(Value *array);
 
 // Register a single value as a GC root (call at init for all global variables
 // that may hold strings)
@@ -36,6 +105,145 @@ void gc_pop_env(void);
 // Force a garbage collection cycle
 void gc_force_collect(void);
 
+// Collection is incremental: on_frame_start spends at most this many
+// microseconds per frame on the cycle in progress (0 = finish each cycle in
+// the frame it starts). Returns the previous budget.
+Value gc_set_frame_budget(Value microseconds);
+Value gc_frame_budget(void);
+
+// Collection triggering. A major cycle starts once the heap has grown by this
+// percentage of what survived the last one (default 100; lower collects more
+// often), and a minor once the nursery has had this many kilobytes allocated
+// (default 1024, clamped to 64..4096). Both return the previous setting.
+Value gc_set_heap_growth(Value percent);
+Value gc_set_nursery_size(Value kilobytes);
+
+// Collector and heap telemetry. A pause is one stretch of collector work the
+// program waits on: a frame's slice (minor and/or major step) or a forced
+// collection. Counters run from startup or the last gc_stat_reset; the rest
+// are current figures.
+#define GC_PAUSE_BUCKETS 8 // < 50, 100, 250, 500, 1000, 2500, 5000 us, more
+
+typedef struct {
+  long majors; // Major cycles completed
+  long minors;
+  long pauses[GC_PAUSE_BUCKETS];
+  long pause_last_us;
+  long pause_max_us;
+  long pause_total_us;
+  long frame_us;           // Collector time in the last on_frame_start
+  long heap_bytes;         // Everything gc-accounted, tables included
+  long string_bytes;       // Heap blocks, per allocation type
+  long list_item_bytes;
+  long float_buffer_bytes;
+  long array_bytes;
+  long map_bytes;
+  long objects; // Handle table slots in use, and allocated
+  long object_capacity;
+  long lists;
+  long list_capacity;
+  long float_buffers;
+  long alloc_failures; // Object/list/float buffer creations that returned 0
+  long allocations;    // Heap blocks plus object/list/float buffer slots
+} GcStats;
+
+void gc_get_stats(GcStats *out);
+
+// The same for nh code, one figure per call. gc_stat_pause_limit is the upper
+// bound of a pause bucket in microseconds (0 for the last, open-ended one).
+Value gc_stat_majors(void);
+Value gc_stat_minors(void);
+Value gc_stat_pauses(Value bucket);
+Value gc_stat_pause_limit(Value bucket);
+Value gc_stat_pause_last(void);
+Value gc_stat_pause_max(void);
+Value gc_stat_frame_us(void);
+Value gc_stat_heap_bytes(void);
+Value gc_stat_string_bytes(void);
+Value gc_stat_list_item_bytes(void);
+Value gc_stat_float_buffer_bytes(void);
+Value gc_stat_array_bytes(void);
+Value gc_stat_map_bytes(void);
+Value gc_stat_objects(void);
+Value gc_stat_object_capacity(void);
+Value gc_stat_lists(void);
+Value gc_stat_list_capacity(void);
+Value gc_stat_float_buffers(void);
+Value gc_stat_alloc_failures(void);
+Value gc_stat_allocations(void);
+void gc_stat_reset(void);
+
+// Write barriers. While a cycle is marking, a value stored into a global,
+// object or list must be shaded so the collector can't miss it, and between
+// cycles a global array slot given a reference must be logged for the next
+// minor collection. The runtime does this for objects and lists; compiled
+// code wraps stores to single globals in GC_WB() and to global array
+// elements in GC_WB_ROOT() (GC_WB_AT() for C code holding just the slot).
+extern int gc_marking;
+void gc_shade(Value v);
+void gc_write_root(Value *slot, Value v);
+void gc_write_root_at(int root, long index, Value v);
+
+// Could v reference the heap (a string or an object/list handle)?
+#define GC_IS_REF(v)                                                           \
+  (IS_OBJ(v) ? (v) != 0                                                        \
+             : (AS_INT(v) & (TYPE_MASK_OBJ | TYPE_MASK_LIST)) != 0)
+
+#define GC_WB(v)                                                               \
+  ({                                                                           \
+    __typeof__(v) __wb = (v);                                                  \
+    if (gc_marking)                                                            \
+      gc_shade((Value)__wb);                                                   \
+    __wb;                                                                      \
+  })
+
+#define GC_WB_AT(slot, v)                                                      \
+  ({                                                                           \
+    Value *__slot = &(slot);                                                   \
+    Value __wb = (v);                                                          \
+    if (GC_IS_REF(__wb))                                                       \
+      gc_write_root(__slot, __wb);                                             \
+    *__slot = __wb;                                                            \
+  })
+
+// GC_WB_AT for array[index], where array is the root array registered as
+// root: no search for the array the slot lies in
+#define GC_WB_ROOT(array, root, index, v)                                      \
+  ({                                                                           \
+    long __at = (index);                                                       \
+    Value __wb = (v);                                                          \
+    if (GC_IS_REF(__wb))                                                       \
+      gc_write_root_at((root), __at, __wb);                                    \
+    (array)[__at] = __wb;                                                      \
+  })
+
+// Shadow stack. Compiled functions push a frame listing the addresses of
+// their parameters and of the locals that may hold heap values, so whatever
+// those reference survives a collection mid-call; every return pops it.
+typedef struct GcFrame {
+  struct GcFrame *prev;
+  Value **slots;
+  int count;
+} GcFrame;
+
+extern GcFrame *gc_frame_top;
+
+#define GC_FRAME(...)                                                          \
+  Value *__gc_slots[] = {__VA_ARGS__};                                         \
+  GcFrame __gc_frame = {gc_frame_top, __gc_slots,                              \
+                        (int)(sizeof(__gc_slots) / sizeof(__gc_slots[0]))};    \
+  gc_frame_top = &__gc_frame
+
+#define GC_FRAME_POP() (gc_frame_top = __gc_frame.prev)
+
+// Return value computed with the frame still pushed
+#define GC_RETURN(v)                                                           \
+  ({                                                                           \
+    __typeof__(v) __ret = (v);                                                 \
+    GC_FRAME_POP();                                                            \
+    __ret;                                                                     \
+  })
+
 // Clear the execution stack (call when interpreter stops)
 void gc_clear_exec_stack(void);
 
@@ -270,6 +478,51 @@ void gl_draw_arrays(Value mode, Value first, Value count);
 // Draw elements
 void gl_draw_elements(Value mode, Value count, Value type, Value offset);
 
+// ============================================================================
+// Typed Arrays
+// Fixed-length runs of int32, uint8 or float32 for bulk game data (tile grids,
+// pathfinding scratch, vertex data), GC-managed like strings. An array value
+// points at its elements the way a string points at its chars, with an
+// ArrayHeader where the StrHeader would be; the tag sits in the length slot,
+// above any real string length. Compiled code indexes arrays whose kind it
+// knows straight through ARRAY_DATA, without bounds checks. The ds_array_*
+// calls check bounds, and clamp [start, end) ranges to the array.
+// ============================================================================
+
+typedef struct {
+  uint32_t tag; // ARRAY_TAG | kind
+  uint32_t count;
+} ArrayHeader;
+
+enum { ARRAY_INT32 = 1, ARRAY_UINT8, ARRAY_FLOAT32 };
+
+#define ARRAY_HEADER(v) ((ArrayHeader *)AS_OBJ(v) - 1)
+#define IS_ARRAY(v) (IS_OBJ(v) && (v) && ARRAY_HEADER(v)->tag >= ARRAY_TAG)
+#define ARRAY_DATA(v, type) ((type *)AS_OBJ(v))
+
+// New zero-filled arrays (0 if count is out of range)
+Value ds_array_int32(Value count);
+Value ds_array_uint8(Value count);
+Value ds_array_float32(Value count);
+Value ds_is_array(Value val);
+Value ds_array_len(Value arr);
+
+// Element access as ints (float32 elements truncate) or as floats
+Value ds_array_get(Value arr, Value index);
+Value ds_array_set(Value arr, Value index, Value value);
+double ds_array_get_float(Value arr, Value index);
+void ds_array_set_float(Value arr, Value index, float value);
+
+// Bulk ops over [start, end)
+Value ds_array_fill(Value arr, Value value, Value start, Value end);
+Value ds_array_fill_float(Value arr, float value, Value start, Value end);
+Value ds_array_add(Value arr, Value delta, Value start, Value end);
+// Index of the first smallest element, -1 for an empty range
+Value ds_array_min_index(Value arr, Value start, Value end);
+// Copy src[start, end) to dst from index at, converting between kinds; the
+// two may overlap
+Value ds_array_copy(Value dst, Value at, Value src, Value start, Value end);
+
 // ============================================================================
 // Buffer Data - Float arrays
 // We need special handling since .nh doesn't have real arrays
@@ -281,7 +534,8 @@ Value buf_create_floats(Value count);
 // Set float at index in buffer
 void buf_set_float(Value buffer, Value index, float value);
 
-// Upload buffer to GL (target, buffer_handle, usage)
+// Upload buffer to GL (target, buffer_handle, usage). A typed array may be
+// passed instead of a handle: its elements are handed to GL in place.
 void buf_upload(Value target, Value buffer_handle, Value usage);
 
 // Free buffer
@@ -463,8 +717,31 @@ Value math_random(Value min, Value max);
 // Object System
 Value ds_object_create(Value count_val, ...);
 Value ds_object_get(Value obj, Value key);
-void ds_object_set(Value *obj, Value key, Value value);
-void ds_set_prop(Value obj, Value key, Value value);
+// Set a prop; 1 if stored. The key must be a literal, or a heap string that
+// is an atom already (see below): any other key is refused, returning 0, and
+// the first refusal is reported. Keys from data belong in a map.
+Value ds_object_set(Value *obj, Value key, Value value);
+Value ds_set_prop(Value obj, Value key, Value value);
+
+// Property-key atoms: each distinct key is interned once and objects store
+// its integer id. The compiler interns every member name it uses in
+// __gc_register_roots, so compiled code passes ids instead of strings.
+int ds_atom_intern(const char *key);
+const char *ds_atom_name(int atom);
+
+// Object literal with pre-interned keys: count, then (int atom, Value) pairs
+Value ds_object_create_atoms(Value count_val, ...);
+
+// Inline caches for property access. The compiler emits one zero-initialised
+// static PropCache per obj->field site; it remembers the last shape seen there
+// and the slot the field lives at, so repeat hits skip the key lookup.
+typedef struct {
+  int shape;      // Shape the cached slot is valid for (0 = empty)
+  int slot;       // Property slot within objects of that shape
+  int transition; // For stores that add a field: the shape after adding it
+} PropCache;
+Value ds_object_get_ic(Value obj, int key, PropCache *ic);
+void ds_object_set_ic(Value *obj, int key, Value value, PropCache *ic);
 
 // String helpers
 Value ds_strlen(Value str);
@@ -506,11 +783,54 @@ Value ds_list_create(void);
 Value ds_list_push(Value list, Value value);
 Value ds_list_get(Value list, Value index);
 Value ds_list_len(Value list);
+Value ds_list_set(Value list, Value index, Value value);
+Value ds_list_pop(Value list);
+Value ds_list_insert(Value list, Value index, Value value);
+Value ds_list_remove(Value list, Value index);
+Value ds_list_slice(Value list, Value start, Value end);
+Value ds_list_reserve(Value list, Value capacity);
+Value ds_list_clear(Value list);
 Value ds_is_list(Value val);
 Value ds_is_object(Value val);
+
+// Maps: hash tables keyed by strings (by content) or ints. A map is an object
+// handle, but it holds no props and fails ds_is_object. ds_map_get is 0 for a
+// missing key, and ds_map_delete 1 if the key was there.
+Value ds_map_create(void);
+Value ds_is_map(Value val);
+Value ds_map_get(Value map, Value key);
+Value ds_map_has(Value map, Value key);
+Value ds_map_set(Value map, Value key, Value value);
+Value ds_map_delete(Value map, Value key);
+Value ds_map_size(Value map);
+Value ds_map_clear(Value map);
+// Iterate with pos = ds_map_next(map, 0), then ds_map_next(map, pos + 1),
+// until -1. Deleting along the way is fine; adding a key may rebuild the table.
+Value ds_map_next(Value map, Value pos);
+Value ds_map_key_at(Value map, Value pos);
+Value ds_map_value_at(Value map, Value pos);
+// Snapshots as new lists, in iteration order
+Value ds_map_keys(Value map);
+Value ds_map_values(Value map);
+
 Value ds_list_to_string(Value list);
 Value ds_json_encode(Value val);
 
+// Stream val as JSON to sink in chunks of up to 4 KB, with no result string.
+// The sink must not modify the values being encoded.
+typedef void (*EncSink)(const char *chars, size_t length, void *ctx);
+void ds_json_write(Value val, EncSink sink, void *ctx);
+
+// Parse JSON into maps, lists, strings and ints; 0 if malformed
+Value ds_json_decode(Value json);
+
+// String builder: append pieces, then finish() into one string
+Value ds_builder_create(void);
+Value ds_builder_append(Value builder, Value str);
+Value ds_builder_append_int(Value builder, Value int_val);
+Value ds_builder_append_char(Value builder, Value char_code);
+Value ds_builder_finish(Value builder);
+
 // ============================================================================
 // Audio
 // ============================================================================
@@ -545,13 +865,6 @@ Value js_call_save_exists(Value slot);
 Value js_call_get_setting(Value key);
 void js_call_set_setting(Value key, Value value);
 
-// ============================================================================
-// JSON Parsing Helpers
-// ============================================================================
-Value js_parse_save_code(Value json);
-Value js_parse_save_upgrades(Value json);
-Value js_parse_save_chat_state(Value json);
-
 // Menu Art Fetching
 Value js_get_menu_art_count(void);
 Value js_get_menu_art_line(Value idx);
@@ -0,0 +1,86 @@
+// Typed array test: an array keeps its tag where a string keeps its length,
+// so every string and object entry point must treat an array as no string
+// (length 0, no hash, never a key) rather than read the tag as a length.
+//
+// Build & run: make test-runtime
+#define GAME_BUILD
+#include "../runtime/runtime.h"
+#include <stdio.h>
+#include <string.h>
+
+static int fail(const char *what) {
+  printf("FAILED: %s\n", what);
+  return 1;
+}
+
+static int equals(Value str, const char *expected) {
+  return str_length(str) == (long)strlen(expected) &&
+         memcmp(AS_OBJ(str), expected, strlen(expected)) == 0;
+}
+
+int main() {
+  printf("Starting Typed Array Test...\n");
+  static Value held[4];
+  gc_register_root_array(held, 4);
+  // An atom exists, so key lookups reach the atom table
+  GC_WB_AT(held[2], ds_object_create(VAL_INT(1), "name", VAL_INT(1)));
+  GC_WB_AT(held[3], ds_builder_create());
+
+  for (int i = 0; i < 2; i++) {
+    int count = i ? 3 : 0;
+    GC_WB_AT(held[i], ds_array_int32(VAL_INT(count)));
+    Value arr = held[i];
+    ds_array_fill(arr, VAL_INT(0x41414141), VAL_INT(0), VAL_INT(count));
+
+    // Read as strings they are empty, and their header is left alone
+    if (AS_INT(ds_strlen(arr)) != 0 || AS_INT(ds_string_length(arr)) != 0 ||
+        str_length(arr) != 0 || str_hash(arr) != 0)
+      return fail("array has a string length or hash");
+    if (AS_INT(ds_array_len(arr)) != count)
+      return fail("array count changed by a string call");
+    if (ds_string_at(arr, VAL_INT(0)) != VAL_INT(0) ||
+        !equals(ds_substring(arr, VAL_INT(0), VAL_INT(8)), ""))
+      return fail("array chars read as a string");
+    if (!equals(ds_string_concat(arr, STR_LIT("ab")), "ab") ||
+        !equals(ds_string_concat(STR_LIT("ab"), arr), "ab") ||
+        !equals(ds_string_insert_char(arr, VAL_INT(0), VAL_INT('x')), "x") ||
+        ds_string_delete_char(arr, VAL_INT(0)) != arr)
+      return fail("array edited as a string");
+    if (AS_INT(ds_streq(arr, STR_LIT(""))) ||
+        AS_INT(val_eq(arr, STR_LIT(""))) ||
+        AS_INT(ds_streq(arr, ds_array_int32(VAL_INT(count)))) ||
+        !AS_INT(val_eq(arr, arr)))
+      return fail("array equal to a string or another array");
+    if (ds_intern(arr) != arr)
+      return fail("array interned");
+
+    // Appending one to a builder adds nothing
+    ds_builder_append(held[3], STR_LIT("<"));
+    ds_builder_append(held[3], arr);
+    ds_builder_append(held[3], STR_LIT(">"));
+    if (!equals(ds_builder_finish(held[3]), "<>"))
+      return fail("array appended to a builder");
+
+    // Never a key: not for objects, and not for maps
+    if (ds_object_set(&held[2], arr, VAL_INT(5)) != VAL_INT(0) ||
+        ds_set_prop(held[2], arr, VAL_INT(5)) != VAL_INT(0) ||
+        ds_object_get(held[2], arr) != VAL_INT(0) ||
+        AS_INT(ds_object_get(held[2], STR_LIT("name"))) != 1 ||
+        !equals(ds_json_encode(held[2]), "{\"name\": 1}"))
+      return fail("array used as an object key");
+    Value map = ds_map_create();
+    ds_map_set(map, arr, VAL_INT(5));
+    if (AS_INT(ds_map_size(map)) != 0 || ds_map_get(map, arr) != VAL_INT(0))
+      return fail("array used as a map key");
+  }
+
+  // The arrays come through all that intact
+  if (AS_INT(ds_array_len(held[1])) != 3 ||
+      AS_INT(ds_array_get(held[1], VAL_INT(2))) != 0x41414141 ||
+      !equals(ds_json_encode(held[1]),
+              "[1094795585, 1094795585, 1094795585]"))
+    return fail("array changed by string and key calls");
+
+  printf("SUCCESS: typed arrays never taken for strings or keys.\n");
+  return 0;
+}
@@ -0,0 +1,67 @@
+// String builder test: appended strings, ints and chars must come out of
+// finish() in order, and a finished builder must start over empty.
+//
+// Build & run: make test-runtime
+#define GAME_BUILD
+#include "../runtime/runtime.h"
+#include <stdio.h>
+#include <string.h>
+
+static int fail(const char *what) {
+  printf("FAILED: %s\n", what);
+  return 1;
+}
+
+static int equals(Value str, const char *expected) {
+  return str_length(str) == (long)strlen(expected) &&
+         memcmp(AS_OBJ(str), expected, strlen(expected)) == 0;
+}
+
+int main() {
+  printf("Starting Builder Test...\n");
+  static Value builder;
+  gc_register_root_value(&builder);
+  builder = ds_builder_create();
+
+  if (!equals(ds_builder_finish(builder), ""))
+    return fail("empty builder not finished to an empty string");
+
+  // Appends chain, and empty strings and NUL chars add nothing
+  ds_builder_append(ds_builder_append(builder, STR_LIT("hp: ")), STR_LIT(""));
+  ds_builder_append_int(builder, VAL_INT(-42));
+  ds_builder_append_char(builder, VAL_INT('/'));
+  ds_builder_append_char(builder, VAL_INT(0));
+  ds_builder_append_int(builder, VAL_INT(100));
+  ds_builder_append_char(builder, VAL_INT(0xe9));
+  Value first = ds_builder_finish(builder);
+  if (!equals(first, "hp: -42/100\xe9"))
+    return fail("pieces not joined in order");
+  if (((char *)AS_OBJ(first))[str_length(first)] != '\0')
+    return fail("finished string not NUL-terminated");
+
+  // Finishing empties the builder, so the next string starts over
+  if (AS_INT(ds_list_len(builder)) != 0)
+    return fail("builder not emptied by finish");
+  ds_builder_append(builder, STR_LIT("again"));
+  Value second = ds_builder_finish(builder);
+  if (!equals(second, "again") || !equals(first, "hp: -42/100\xe9"))
+    return fail("builder reused after finish kept old pieces");
+
+  // Many pieces, through a collection between appends
+  char expected[4000];
+  size_t length = 0;
+  for (int i = 0; i < 1000; i++) {
+    ds_builder_append_int(builder, VAL_INT(i % 10));
+    ds_builder_append_char(builder, VAL_INT('a' + i % 26));
+    expected[length++] = (char)('0' + i % 10);
+    expected[length++] = (char)('a' + i % 26);
+    if (i == 500)
+      gc_force_collect();
+  }
+  expected[length] = '\0';
+  if (!equals(ds_builder_finish(builder), expected))
+    return fail("long build lost or reordered pieces");
+
+  printf("SUCCESS: builder joined, emptied and reused.\n");
+  return 0;
+}
@@ -0,0 +1,164 @@
+// Telemetry test: the figures in GcStats must follow what the program
+// allocates and what collections free, and pauses must be counted.
+//
+// Build & run: make test-gc
+#define GAME_BUILD
+#include "../runtime/runtime.h"
+#include <stdio.h>
+
+#define COUNT 1000
+
+static Value held[COUNT];
+
+static int fail(const char *what) {
+  printf("FAILED: %s\n", what);
+  return 1;
+}
+
+int main() {
+  printf("Starting GC Stats Test...\n");
+  gc_register_root_array(held, COUNT);
+  gc_force_collect();
+  gc_stat_reset();
+
+  GcStats before, after;
+  gc_get_stats(&before);
+
+  for (int i = 0; i < COUNT; i++) {
+    Value list = ds_list_create();
+    ds_list_push(list, ds_int_to_string(VAL_INT(100000 + i)));
+    ds_list_push(list, ds_object_create(VAL_INT(0)));
+    // Past the inline items, so the list spills to a heap array
+    for (int j = 0; j < 30; j++)
+      ds_list_push(list, VAL_INT(j));
+    GC_WB_AT(held[i], list);
+  }
+  gc_get_stats(&after);
+  if (after.objects - before.objects != COUNT ||
+      after.lists - before.lists != COUNT)
+    return fail("objects/lists in use not counted");
+  if (after.object_capacity < after.objects ||
+      after.list_capacity < after.lists)
+    return fail("table capacity below slots in use");
+  if (after.string_bytes <= before.string_bytes ||
+      after.list_item_bytes <= before.list_item_bytes)
+    return fail("bytes per allocation type not counted");
+  if (after.allocations - before.allocations < 4 * COUNT)
+    return fail("allocations not counted");
+  if (after.string_bytes + after.list_item_bytes + after.float_buffer_bytes +
+          after.array_bytes + after.map_bytes >
+      after.heap_bytes)
+    return fail("bytes per type exceed the heap");
+
+  // Drop half: the next collection gives their slots and bytes back
+  for (int i = 0; i < COUNT / 2; i++) {
+    held[i] = VAL_INT(0);
+  }
+  gc_force_collect();
+  GcStats collected;
+  gc_get_stats(&collected);
+  if (collected.objects - before.objects != COUNT / 2 ||
+      collected.lists - before.lists != COUNT / 2)
+    return fail("freed objects/lists still counted");
+  if (collected.string_bytes >= after.string_bytes ||
+      collected.heap_bytes >= after.heap_bytes)
+    return fail("freed bytes still counted");
+  if (collected.majors != 1)
+    return fail("major cycle not counted");
+
+  long pauses = 0;
+  for (int b = 0; b < GC_PAUSE_BUCKETS; b++) {
+    pauses += collected.pauses[b];
+    if (AS_INT(gc_stat_pauses(VAL_INT(b))) != collected.pauses[b])
+      return fail("gc_stat_pauses disagrees with gc_get_stats");
+  }
+  if (pauses != 1 || collected.pause_max_us < collected.pause_last_us)
+    return fail("forced collection not recorded as a pause");
+
+  // Single chars and small ints come from the immortal tables
+  GcStats before_small;
+  gc_get_stats(&before_small);
+  for (int i = 0; i < 256; i++) {
+    ds_char_to_string(VAL_INT(i));
+    ds_int_to_string(VAL_INT(i - 100));
+  }
+  GcStats after_small;
+  gc_get_stats(&after_small);
+  if (after_small.string_bytes != before_small.string_bytes)
+    return fail("single-char or small-int strings allocated");
+
+  // Short lists keep their items inline
+  Value pair = ds_list_create();
+  ds_list_push(pair, VAL_INT(1));
+  ds_list_push(pair, VAL_INT(2));
+  GcStats after_pair;
+  gc_get_stats(&after_pair);
+  if (after_pair.list_item_bytes != after_small.list_item_bytes ||
+      AS_INT(ds_list_get(pair, VAL_INT(1))) != 2)
+    return fail("short list allocated an items array");
+
+  // Typed arrays are one block each, counted as array bytes until dropped
+  GC_WB_AT(held[0], ds_array_int32(VAL_INT(COUNT)));
+  GC_WB_AT(held[1], ds_array_uint8(VAL_INT(COUNT)));
+  GcStats after_arrays;
+  gc_get_stats(&after_arrays);
+  if (after_arrays.array_bytes - after_pair.array_bytes < 5 * COUNT)
+    return fail("typed array bytes not counted");
+  ds_array_fill(held[0], VAL_INT(7), VAL_INT(0), VAL_INT(COUNT));
+  ds_array_add(held[0], VAL_INT(-3), VAL_INT(10), VAL_INT(20));
+  ds_array_copy(held[1], VAL_INT(0), held[0], VAL_INT(0), VAL_INT(COUNT));
+  if (AS_INT(ds_array_min_index(held[1], VAL_INT(0), VAL_INT(COUNT))) != 10 ||
+      AS_INT(ds_array_get(held[1], VAL_INT(19))) != 4 ||
+      AS_INT(ds_array_len(held[1])) != COUNT)
+    return fail("typed array fill, add or copy wrong");
+  held[0] = held[1] = VAL_INT(0);
+  gc_force_collect();
+  GcStats dropped;
+  gc_get_stats(&dropped);
+  if (dropped.array_bytes != after_pair.array_bytes)
+    return fail("freed typed array bytes still counted");
+
+  // A map keeps its string keys and values alive through a collection, and
+  // its table is counted as map bytes until dropped
+  GC_WB_AT(held[0], ds_map_create());
+  for (int i = 0; i < COUNT; i++) {
+    ds_map_set(held[0], ds_int_to_string(VAL_INT(100000 + i)),
+               ds_int_to_string(VAL_INT(i)));
+    ds_map_set(held[0], VAL_INT(i), VAL_INT(i * 2));
+  }
+  for (int i = 0; i < COUNT; i += 2)
+    ds_map_delete(held[0], VAL_INT(i));
+  gc_force_collect();
+  GcStats after_map;
+  gc_get_stats(&after_map);
+  Value key = ds_int_to_string(VAL_INT(100000 + 7));
+  if (after_map.map_bytes - dropped.map_bytes < COUNT * 2 * sizeof(Value) ||
+      AS_INT(ds_map_size(held[0])) != COUNT + COUNT / 2 ||
+      AS_INT(ds_streq(ds_map_get(held[0], key),
+                      ds_int_to_string(VAL_INT(7)))) == 0 ||
+      AS_INT(ds_map_get(held[0], VAL_INT(7))) != 14 ||
+      AS_INT(ds_map_has(held[0], VAL_INT(8))) != 0)
+    return fail("map entries lost or bytes not counted");
+  if (AS_INT(ds_is_object(held[0])) || !AS_INT(ds_is_map(held[0])))
+    return fail("map taken for an object");
+  long visited = 0;
+  for (Value pos = ds_map_next(held[0], VAL_INT(0)); AS_INT(pos) >= 0;
+       pos = ds_map_next(held[0], VAL_INT(AS_INT(pos) + 1)))
+    visited++;
+  if (visited != COUNT + COUNT / 2)
+    return fail("map iteration missed entries");
+  held[0] = VAL_INT(0);
+  gc_force_collect();
+  GcStats map_dropped;
+  gc_get_stats(&map_dropped);
+  if (map_dropped.map_bytes != dropped.map_bytes)
+    return fail("freed map bytes still counted");
+
+  if (AS_INT(gc_stat_float_buffers()) != 0 ||
+      AS_INT(gc_stat_alloc_failures()) != 0)
+    return fail("unexpected float buffers or allocation failures");
+
+  printf("SUCCESS: stats tracked %d objects/lists through a collection.\n",
+         COUNT);
+  return 0;
+}
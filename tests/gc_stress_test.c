@@ -58,10 +58,11 @@ int main() {
 
     // Set a property. This allocates a string for the key "prop".
     // "prop" keys are duplicated allocations in current runtime
-    ds_set_prop(obj, VAL_OBJ("a"), VAL_INT(i));
+    ds_set_prop(obj, STR_LIT("a"), VAL_INT(i));
 
-    // Store object handle in roots to keep it alive
-    roots[i] = obj;
+    // Store object handle in roots to keep it alive (through the barrier, as
+    // compiled code does, so a minor collection sees the slot)
+    GC_WB_AT(roots[i], obj);
   }
 
   printf("Allocations done. Triggering GC...\n");
@@ -76,7 +77,7 @@ int main() {
     Value obj = roots[i];
     // This get will compare the key "a" (literal) with the stored key
     // If stored key was freed, we crash or get garbage
-    Value val = ds_object_get(obj, VAL_OBJ("a"));
+    Value val = ds_object_get(obj, STR_LIT("a"));
     if (AS_INT(val) != i) {
       printf("FAILED: Object %d lost its property! Got %ld, expected %d\n", i,
              AS_INT(val), i);
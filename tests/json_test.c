@@ -0,0 +1,225 @@
+// JSON test. The encoder must escape what JSON needs, stop at cycles, never
+// truncate long output, and stream the same bytes through a ds_json_write
+// sink as ds_json_encode returns. The decoder must refuse malformed text and
+// nesting past its cap, decode escapes to UTF-8, and keep every key of an
+// object, however many, without making atoms.
+//
+// Build & run: make test-runtime
+#define GAME_BUILD
+#include "../runtime/runtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ITEMS 3000
+
+static int fail(const char *what) {
+  printf("FAILED: %s\n", what);
+  return 1;
+}
+
+static int equals(Value str, const char *expected, size_t length) {
+  return str_length(str) == (long)length &&
+         memcmp(AS_OBJ(str), expected, length) == 0;
+}
+
+#define EQUALS(str, lit) equals(str, lit, sizeof(lit) - 1)
+
+// Collects what ds_json_write streams
+typedef struct {
+  char *chars;
+  size_t length;
+  int chunks;
+  size_t largest;
+} Collected;
+
+static void collect(const char *chars, size_t length, void *ctx) {
+  Collected *c = ctx;
+  c->chars = realloc(c->chars, c->length + length);
+  memcpy(c->chars + c->length, chars, length);
+  c->length += length;
+  c->chunks++;
+  if (length > c->largest)
+    c->largest = length;
+}
+
+static Value decode(const char *json) {
+  return ds_json_decode(str_from_c(json));
+}
+
+// The sink must see exactly what ds_json_encode returns
+static int streams_same(Value val, Collected *c) {
+  memset(c, 0, sizeof(*c));
+  ds_json_write(val, collect, c);
+  Value whole = ds_json_encode(val);
+  return equals(whole, c->chars, c->length);
+}
+
+int main() {
+  printf("Starting JSON Test...\n");
+  static Value held[4];
+  gc_register_root_array(held, 4);
+
+  // A container met again on its own path: "..." for display, null in JSON
+  GC_WB_AT(held[0], ds_object_create(VAL_INT(2), "name", STR_LIT("loop"),
+                                     "self", VAL_INT(0)));
+  ds_object_set(&held[0], STR_LIT("self"), held[0]);
+  GC_WB_AT(held[1], ds_list_create());
+  ds_list_push(held[1], VAL_INT(1));
+  ds_list_push(held[1], held[1]);
+  ds_list_push(held[1], held[0]);
+  if (!EQUALS(ds_val_to_string(held[0]), "{name: \"loop\", self: ...}") ||
+      !EQUALS(ds_json_encode(held[0]), "{\"name\": \"loop\", \"self\": null}"))
+    return fail("object cycle not cut");
+  if (!EQUALS(ds_val_to_string(held[1]),
+              "[1, ..., {name: \"loop\", self: ...}]") ||
+      !EQUALS(ds_json_encode(held[1]),
+              "[1, null, {\"name\": \"loop\", \"self\": null}]"))
+    return fail("list cycle not cut");
+  // A container seen twice but not on its own path is written out both times
+  GC_WB_AT(held[2], ds_list_create());
+  ds_list_push(held[2], held[0]);
+  ds_list_push(held[2], held[0]);
+  if (!EQUALS(ds_json_encode(held[2]), "[{\"name\": \"loop\", \"self\": null}, "
+                                       "{\"name\": \"loop\", \"self\": null}]"))
+    return fail("shared container taken for a cycle");
+
+  // Quotes, backslashes and control chars are escaped in JSON only
+  Value odd = str_from_c("say \"hi\"\\\n\t\r\x01\x1f end");
+  if (!EQUALS(ds_json_encode(odd),
+              "\"say \\\"hi\\\"\\\\\\n\\t\\r\\u0001\\u001f end\""))
+    return fail("JSON string escapes wrong");
+  if (!EQUALS(ds_val_to_string(odd), "\"say \"hi\"\\\n\t\r\x01\x1f end\""))
+    return fail("display string was escaped");
+  GC_WB_AT(held[3], ds_object_create(VAL_INT(1), "k\"ey", odd));
+  if (!EQUALS(ds_json_encode(held[3]),
+              "{\"k\\\"ey\": \"say \\\"hi\\\"\\\\\\n\\t\\r\\u0001\\u001f "
+              "end\"}"))
+    return fail("JSON key escapes wrong");
+
+  // Output well past one 4 KB chunk comes back whole
+  static char expected[ITEMS * 16];
+  size_t length = 0;
+  GC_WB_AT(held[2], ds_list_create());
+  expected[length++] = '[';
+  for (int i = 0; i < ITEMS; i++) {
+    ds_list_push(held[2], ds_int_to_string(VAL_INT(i)));
+    length += sprintf(expected + length, "%s\"%d\"", i ? ", " : "", i);
+  }
+  expected[length++] = ']';
+  if (length < 4 * 4096 || !equals(ds_json_encode(held[2]), expected, length))
+    return fail("long output truncated");
+
+  // Streamed in chunks of at most 4 KB, the same bytes as the string
+  Collected c;
+  if (!streams_same(held[2], &c) || c.chunks < 4 || c.largest > 4096)
+    return fail("chunked write differs from ds_json_encode");
+  free(c.chars);
+
+  // A string longer than a chunk is split across chunks, escapes and all
+  char *big = malloc(10001);
+  for (int i = 0; i < 10000; i++)
+    big[i] = i == 5000 ? '"' : 'a' + i % 26;
+  big[10000] = '\0';
+  ds_list_push(held[2], str_from_c(big));
+  free(big);
+  if (!streams_same(held[2], &c) || c.largest > 4096)
+    return fail("long string written through the sink differs");
+  free(c.chars);
+  if (!streams_same(held[1], &c) || c.chunks != 1)
+    return fail("short output not written as one chunk");
+  free(c.chars);
+
+  // Malformed text decodes to 0, however far it got
+  const char *malformed[] = {"[1, 2,]",  "{\"a\": 1,}", "{\"a\" 1}",
+                             "{\"a\": }", "{a: 1}",      "[1 2]",
+                             "\"open",    "\"\\x\"",     "\"\\u12g4\"",
+                             "tru",      "[1] 2",       "",
+                             "-",        "{\"a\": [1}"};
+  for (size_t i = 0; i < sizeof(malformed) / sizeof(*malformed); i++)
+    if (decode(malformed[i]) != VAL_INT(0))
+      return fail(malformed[i]);
+
+  // Escapes become UTF-8; a surrogate pair is one 4-byte char
+  if (!EQUALS(decode("\"a\\\"b\\\\\\/\\n\\u0041\\u00e9\\u20ac\\ud83d\\ude00\""),
+              "a\"b\\/\nA\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80"))
+    return fail("string escapes decoded wrong");
+  GC_WB_AT(held[0], decode(" [-12, 3.75, true, false, null, 1e2] "));
+  if (AS_INT(ds_list_len(held[0])) != 6 ||
+      AS_INT(ds_list_get(held[0], VAL_INT(0))) != -12 ||
+      AS_INT(ds_list_get(held[0], VAL_INT(1))) != 3 ||
+      AS_INT(ds_list_get(held[0], VAL_INT(2))) != 1 ||
+      ds_list_get(held[0], VAL_INT(4)) != VAL_INT(0) ||
+      AS_INT(ds_list_get(held[0], VAL_INT(5))) != 100)
+    return fail("numbers and literals decoded wrong");
+
+  // Nesting is capped at 512 levels below the top
+  char *deep = malloc(2 * 520 + 2);
+  for (int levels = 512; levels <= 514; levels++) {
+    int n = 0;
+    for (int i = 0; i <= levels; i++)
+      deep[n++] = '[';
+    for (int i = 0; i <= levels; i++)
+      deep[n++] = ']';
+    deep[n] = '\0';
+    if ((decode(deep) != VAL_INT(0)) != (levels == 512))
+      return fail("nesting cap not at 512 levels");
+  }
+  free(deep);
+
+  // Objects become maps, so past 256 keys nothing is dropped, and decoding
+  // a key nobody interned makes no atom
+  char *wide = malloc(300 * 24);
+  size_t at = 0;
+  wide[at++] = '{';
+  for (int i = 0; i < 300; i++)
+    at += sprintf(wide + at, "%s\"json_test_k%d\": %d", i ? ", " : "", i, i);
+  wide[at++] = '}';
+  wide[at] = '\0';
+  GC_WB_AT(held[0], decode(wide));
+  free(wide);
+  if (!AS_INT(ds_is_map(held[0])) || AS_INT(ds_map_size(held[0])) != 300 ||
+      AS_INT(ds_map_get(held[0], str_from_c("json_test_k0"))) != 0 ||
+      AS_INT(ds_map_get(held[0], str_from_c("json_test_k299"))) != 299)
+    return fail("wide object lost keys");
+  // ds_object_set takes a heap string key only if it is an atom already,
+  // and says whether it stored the value
+  GC_WB_AT(held[1], ds_object_create(VAL_INT(0)));
+  if (ds_object_set(&held[1], str_from_c("json_test_k7"), VAL_INT(7)) !=
+          VAL_INT(0) ||
+      ds_set_prop(held[1], str_from_c("json_test_k7"), VAL_INT(7)) !=
+          VAL_INT(0))
+    return fail("key nobody interned reported as set");
+  if (ds_object_get(held[1], STR_LIT("json_test_k7")) != VAL_INT(0))
+    return fail("decoded key made an atom");
+  if (ds_object_set(&held[1], str_from_c("name"), VAL_INT(7)) != VAL_INT(1) ||
+      ds_set_prop(held[1], STR_LIT("json_test_literal"), VAL_INT(8)) !=
+          VAL_INT(1) ||
+      ds_object_set(&held[1], ds_intern(str_from_c("json_test_k7")),
+                    VAL_INT(9)) != VAL_INT(1))
+    return fail("atom or literal key reported as not set");
+  if (AS_INT(ds_object_get(held[1], STR_LIT("name"))) != 7 ||
+      AS_INT(ds_object_get(held[1], STR_LIT("json_test_literal"))) != 8 ||
+      AS_INT(ds_object_get(held[1], STR_LIT("json_test_k7"))) != 9)
+    return fail("atom or literal key not set");
+
+  // A save as js_load_game reads it
+  GC_WB_AT(held[0], decode("{\"code\": \"move(1)\\nwait()\", "
+                           "\"upgrades\": \"0101\", \"chat_state\": \"1,0,1\", "
+                           "\"extra\": {\"nested\": [1]}}"));
+  if (!EQUALS(ds_map_get(held[0], STR_LIT("code")), "move(1)\nwait()") ||
+      !EQUALS(ds_map_get(held[0], STR_LIT("upgrades")), "0101") ||
+      !EQUALS(ds_map_get(held[0], STR_LIT("chat_state")), "1,0,1") ||
+      ds_map_get(held[0], STR_LIT("missing")) != VAL_INT(0))
+    return fail("save fields decoded wrong");
+  // The nested map and its keys survive a collection
+  gc_force_collect();
+  Value extra = ds_map_get(held[0], STR_LIT("extra"));
+  Value nested = ds_map_get(extra, STR_LIT("nested"));
+  if (AS_INT(ds_list_get(nested, VAL_INT(0))) != 1 ||
+      !EQUALS(ds_json_encode(extra), "{\"nested\": [1]}"))
+    return fail("decoded map lost through a collection");
+
+  printf("SUCCESS: JSON encoded, streamed and decoded.\n");
+  return 0;
+}
@@ -0,0 +1,129 @@
+// List test: set, pop, insert, remove, slice, reserve and clear must keep
+// the items in order and in bounds, inline or spilled to a heap array.
+//
+// Build & run: make test-runtime
+#define GAME_BUILD
+#include "../runtime/runtime.h"
+#include <stdio.h>
+
+static int fail(const char *what) {
+  printf("FAILED: %s\n", what);
+  return 1;
+}
+
+// Does list hold exactly the ints in expected?
+static int holds(Value list, const long *expected, long count) {
+  if (AS_INT(ds_list_len(list)) != count)
+    return 0;
+  for (long i = 0; i < count; i++)
+    if (AS_INT(ds_list_get(list, VAL_INT(i))) != expected[i])
+      return 0;
+  return 1;
+}
+
+#define HOLDS(list, ...)                                                       \
+  holds(list, (const long[]){__VA_ARGS__},                                     \
+        sizeof((const long[]){__VA_ARGS__}) / sizeof(long))
+
+int main() {
+  printf("Starting List Test...\n");
+  static Value held[2];
+  gc_register_root_array(held, 2);
+  GC_WB_AT(held[0], ds_list_create());
+  Value list = held[0];
+
+  // Pop on an empty list is 0 and leaves it empty
+  if (ds_list_pop(list) != VAL_INT(0) || AS_INT(ds_list_len(list)) != 0)
+    return fail("pop on an empty list");
+
+  // Insert at 0 and at the length; anything further out is refused
+  ds_list_insert(list, VAL_INT(0), VAL_INT(2));
+  ds_list_insert(list, VAL_INT(0), VAL_INT(1));
+  ds_list_insert(list, VAL_INT(2), VAL_INT(4));
+  ds_list_insert(list, VAL_INT(2), VAL_INT(3));
+  ds_list_insert(list, VAL_INT(5), VAL_INT(99));
+  ds_list_insert(list, VAL_INT(-1), VAL_INT(99));
+  if (!HOLDS(list, 1, 2, 3, 4))
+    return fail("insert at 0, in the middle or at the length");
+
+  // Set replaces in range only
+  ds_list_set(list, VAL_INT(1), VAL_INT(20));
+  ds_list_set(list, VAL_INT(4), VAL_INT(99));
+  ds_list_set(list, VAL_INT(-1), VAL_INT(99));
+  if (!HOLDS(list, 1, 20, 3, 4))
+    return fail("set out of range changed the list");
+
+  // Remove returns the item and shifts the tail down
+  if (AS_INT(ds_list_remove(list, VAL_INT(1))) != 20 ||
+      !HOLDS(list, 1, 3, 4))
+    return fail("remove did not shift the tail");
+  if (ds_list_remove(list, VAL_INT(3)) != VAL_INT(0) ||
+      ds_list_remove(list, VAL_INT(-1)) != VAL_INT(0) || !HOLDS(list, 1, 3, 4))
+    return fail("remove out of range changed the list");
+  if (AS_INT(ds_list_pop(list)) != 4 || !HOLDS(list, 1, 3))
+    return fail("pop did not take the last item");
+
+  // Inserting at the front past the inline items spills them in order
+  for (long i = 0; i < 40; i++)
+    ds_list_insert(list, VAL_INT(0), VAL_INT(100 + i));
+  if (AS_INT(ds_list_len(list)) != 42 ||
+      AS_INT(ds_list_get(list, VAL_INT(0))) != 139 ||
+      AS_INT(ds_list_get(list, VAL_INT(39))) != 100 ||
+      AS_INT(ds_list_get(list, VAL_INT(41))) != 3)
+    return fail("insert past the inline items lost order");
+  ds_list_remove(list, VAL_INT(0));
+  if (AS_INT(ds_list_get(list, VAL_INT(0))) != 138 ||
+      AS_INT(ds_list_get(list, VAL_INT(40))) != 3)
+    return fail("remove from a spilled list did not shift the tail");
+
+  // Slice copies [start, end), clamping bounds to the list
+  Value slice = ds_list_slice(list, VAL_INT(38), VAL_INT(41));
+  if (!HOLDS(slice, 100, 1, 3))
+    return fail("slice in range");
+  if (AS_INT(ds_list_len(ds_list_slice(list, VAL_INT(-5), VAL_INT(1000)))) !=
+          41 ||
+      AS_INT(ds_list_len(ds_list_slice(list, VAL_INT(30), VAL_INT(10)))) != 0 ||
+      AS_INT(ds_list_len(ds_list_slice(VAL_INT(0), VAL_INT(0), VAL_INT(5)))) !=
+          0)
+    return fail("slice bounds not clamped");
+  ds_list_set(slice, VAL_INT(0), VAL_INT(7));
+  if (AS_INT(ds_list_get(list, VAL_INT(38))) != 100)
+    return fail("slice shares items with its source");
+
+  // Reserve makes room up front: pushes up to it allocate nothing
+  GC_WB_AT(held[1], ds_list_create());
+  if (ds_list_reserve(held[1], VAL_INT(1000)) != VAL_INT(1))
+    return fail("reserve refused");
+  GcStats before, after;
+  gc_get_stats(&before);
+  for (long i = 0; i < 1000; i++)
+    ds_list_push(held[1], VAL_INT(i));
+  gc_get_stats(&after);
+  if (after.allocations != before.allocations ||
+      AS_INT(ds_list_get(held[1], VAL_INT(999))) != 999)
+    return fail("pushes within the reserve allocated");
+  if (ds_list_reserve(held[1], VAL_INT(10)) != VAL_INT(1) ||
+      AS_INT(ds_list_len(held[1])) != 1000)
+    return fail("smaller reserve shrank the list");
+  if (ds_list_reserve(held[1], VAL_INT(1L << 40)) != VAL_INT(0))
+    return fail("impossible reserve accepted");
+
+  // Clear empties the list, keeping its buffer for refilling
+  ds_list_clear(held[1]);
+  gc_get_stats(&before);
+  for (long i = 0; i < 1000; i++)
+    ds_list_push(held[1], VAL_INT(-i));
+  gc_get_stats(&after);
+  if (after.allocations != before.allocations ||
+      AS_INT(ds_list_get(held[1], VAL_INT(999))) != -999)
+    return fail("refilling a cleared list allocated");
+
+  // Everything survives a collection
+  gc_force_collect();
+  if (AS_INT(ds_list_get(held[0], VAL_INT(40))) != 3 ||
+      AS_INT(ds_list_len(held[1])) != 1000)
+    return fail("lists lost through a collection");
+
+  printf("SUCCESS: list operations kept order and bounds.\n");
+  return 0;
+}
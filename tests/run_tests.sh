@@ -38,6 +38,7 @@ cat > "$TMP_DIR/runtime.h" << 'EOF'
 #ifndef RUNTIME_H
 #define RUNTIME_H
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
@@ -56,10 +57,23 @@ typedef long Value;
 #define AS_OBJ(x) ((void *)(x))
 #define IS_INT(x) (((x) & 1))
 #define IS_OBJ(x) (!((x) & 1))
+#define MATCH_INT(x) (IS_INT(x) ? AS_INT(x) : (-__LONG_MAX__ - 1))
+
+// String literals: plain C strings here (the real runtime adds a header)
+#define NH_STR_DEF(name, length, hash, lit) static char name[] = lit
+#define NH_STR(name) VAL_OBJ(name)
 
 // GC stubs (no-op for test environment)
-static inline void gc_register_root_array(Value *array, int size) { (void)array; (void)size; }
+static inline int gc_register_root_array(Value *array, int size) { (void)array; (void)size; return 0; }
 static inline void gc_register_root_value(Value *value_ptr) { (void)value_ptr; }
+#define GC_WB(v) (v)
+#define GC_WB_AT(slot, v) ((slot) = (v))
+#define GC_WB_ROOT(array, root, index, v) ((array)[index] = (v))
+typedef struct GcFrame { struct GcFrame *prev; Value **slots; int count; } GcFrame;
+static GcFrame *gc_frame_top;
+#define GC_FRAME(...) Value *__gc_slots[] = {__VA_ARGS__}; GcFrame __gc_frame = {gc_frame_top, __gc_slots, sizeof(__gc_slots) / sizeof(__gc_slots[0])}; gc_frame_top = &__gc_frame
+#define GC_FRAME_POP() (gc_frame_top = __gc_frame.prev)
+#define GC_RETURN(v) ({ __typeof__(v) __ret = (v); GC_FRAME_POP(); __ret; })
 
 static inline void console_log(Value msg) { printf("%s\n", (const char *)AS_OBJ(msg)); }
 static inline void console_log_int(Value value) { printf("%ld\n", AS_INT(value)); }
@@ -172,6 +186,48 @@ static inline void ds_set_prop(Value obj, Value key_val, Value value) {
     ds_object_set_impl(&handle, key, value);
 }
 
+// Interning: literals are plain C strings here, so there is nothing to do
+static inline Value ds_intern(Value str) { return str; }
+static inline Value ds_intern_literal(Value lit) { return lit; }
+
+// Atoms: a plain intern table so ids map back to their key strings
+static const char *stub_atoms[4096];
+static int stub_atom_count = 1;
+static inline int ds_atom_intern(const char *key) {
+    for (int i = 1; i < stub_atom_count; i++) {
+        if (strcmp(stub_atoms[i], key) == 0) return i;
+    }
+    stub_atoms[stub_atom_count] = strdup(key);
+    return stub_atom_count++;
+}
+
+static inline Value ds_object_create_atoms(Value count_val, ...) {
+  int count = (int)AS_INT(count_val);
+  Value handle = alloc_object();
+  if (handle == 0) return VAL_INT(0);
+
+  va_list args;
+  va_start(args, count_val);
+  for (int i = 0; i < count; i++) {
+    int key = va_arg(args, int);
+    Value val = va_arg(args, Value);
+    ds_object_set_impl(&handle, stub_atoms[key], val);
+  }
+  va_end(args);
+  return handle;
+}
+
+// Inline caches are a no-op here: just forward to the uncached lookups
+typedef struct { int shape; int slot; int transition; } PropCache;
+static inline Value ds_object_get_ic(Value obj, int key, PropCache *ic) {
+    (void)ic;
+    return ds_object_get(obj, VAL_OBJ(stub_atoms[key]));
+}
+static inline void ds_object_set_ic(Value *obj, int key, Value value, PropCache *ic) {
+    (void)ic;
+    ds_object_set(obj, VAL_OBJ(stub_atoms[key]), value);
+}
+
 // ============================================================================
 // String / Helpers
 // ============================================================================
@@ -199,6 +255,75 @@ static inline Value val_eq(Value a, Value b) {
     return VAL_INT(strcmp(s1, s2) == 0);
 }
 
+// ============================================================================
+// Typed Arrays (the same layout as the real runtime, minus the GC)
+// ============================================================================
+
+typedef struct { uint32_t tag; uint32_t count; } ArrayHeader;
+#define ARRAY_DATA(v, type) ((type *)AS_OBJ(v))
+
+static inline Value stub_array(Value count, size_t size) {
+    ArrayHeader *h = calloc(1, sizeof(ArrayHeader) + AS_INT(count) * size);
+    h->count = (uint32_t)AS_INT(count);
+    return VAL_OBJ(h + 1);
+}
+static inline Value ds_array_int32(Value count) { return stub_array(count, 4); }
+static inline Value ds_array_uint8(Value count) { return stub_array(count, 1); }
+static inline Value ds_array_float32(Value count) { return stub_array(count, 4); }
+static inline Value ds_array_len(Value arr) { return VAL_INT(((ArrayHeader *)AS_OBJ(arr) - 1)->count); }
+static inline Value ds_array_fill(Value arr, Value value, Value start, Value end) {
+    for (long i = AS_INT(start); i < AS_INT(end); i++) ARRAY_DATA(arr, int)[i] = (int)AS_INT(value);
+    return VAL_INT(0);
+}
+static inline Value ds_array_min_index(Value arr, Value start, Value end) {
+    long best = AS_INT(start);
+    for (long i = best + 1; i < AS_INT(end); i++)
+        if (ARRAY_DATA(arr, int)[i] < ARRAY_DATA(arr, int)[best]) best = i;
+    return VAL_INT(best);
+}
+
+// ============================================================================
+// Maps (a linear-scan stand-in for the real hash table)
+// ============================================================================
+
+typedef struct { int count; Value keys[64]; Value vals[64]; } StubMap;
+
+static inline int stub_map_find(Value map, Value key) {
+    StubMap *m = (StubMap *)AS_OBJ(map);
+    for (int i = 0; i < m->count; i++)
+        if (m->keys[i] == key || (IS_OBJ(key) && IS_OBJ(m->keys[i]) &&
+                                  strcmp(AS_OBJ(key), AS_OBJ(m->keys[i])) == 0))
+            return i;
+    return -1;
+}
+static inline Value ds_map_create(void) { return VAL_OBJ(calloc(1, sizeof(StubMap))); }
+static inline Value ds_map_get(Value map, Value key) {
+    int i = stub_map_find(map, key);
+    return i < 0 ? VAL_INT(0) : ((StubMap *)AS_OBJ(map))->vals[i];
+}
+static inline Value ds_map_has(Value map, Value key) { return VAL_INT(stub_map_find(map, key) >= 0); }
+static inline Value ds_map_set(Value map, Value key, Value value) {
+    StubMap *m = (StubMap *)AS_OBJ(map);
+    int i = stub_map_find(map, key);
+    if (i < 0) { i = m->count++; m->keys[i] = key; }
+    m->vals[i] = value;
+    return VAL_INT(0);
+}
+static inline Value ds_map_delete(Value map, Value key) {
+    StubMap *m = (StubMap *)AS_OBJ(map);
+    int i = stub_map_find(map, key);
+    if (i < 0) return VAL_INT(0);
+    m->count--;
+    m->keys[i] = m->keys[m->count];
+    m->vals[i] = m->vals[m->count];
+    return VAL_INT(1);
+}
+static inline Value ds_map_size(Value map) { return VAL_INT(((StubMap *)AS_OBJ(map))->count); }
+static inline Value ds_map_next(Value map, Value pos) {
+    return AS_INT(pos) < ((StubMap *)AS_OBJ(map))->count ? pos : VAL_INT(-1);
+}
+static inline Value ds_map_value_at(Value map, Value pos) { return ((StubMap *)AS_OBJ(map))->vals[AS_INT(pos)]; }
+
 // ============================================================================
 // Stubs
 // ============================================================================
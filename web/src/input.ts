@@ -15,7 +15,8 @@ const codeKeyMap: Record<string, number> = {
   Delete: 12,
   Home: 13,
   End: 14,
-  Escape: 15
+  Escape: 15,
+  F3: 16
 }
 
 // Letter keys (a-z) key codes for key press detection (vim mode, etc.)